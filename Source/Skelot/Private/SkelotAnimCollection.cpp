@@ -8,6 +8,7 @@
 #include "Engine/SkeletalMeshSocket.h"
 #include "DrawDebugHelpers.h"
 #include "Misc/MemStack.h"
+#include "Algo/StableSort.h"
 #include "EngineUtils.h"
 #include "MeshDrawShaderBindings.h"
 #include "MeshMaterialShader.h"
@@ -51,6 +52,8 @@
 #include "Animation/AnimComposite.h"
 #include "AssetRegistry/AssetData.h"
 #include "SkelotClusterComponent.h"
+#include "SkelotWorld.h"
+#include "UObject/UObjectIterator.h"
 #include "RenderGraphBuilder.h"
 #include "AnimationUtils.h"
 #include "UObject/LinkerLoad.h"
@@ -348,10 +351,7 @@ const FTransform3f& USkelotAnimCollection::GetBoneTransform(uint32 SkeletonBoneI
 {
 	if (IsBoneTransformCached(SkeletonBoneIndex))
 	{
-		if (IsAnimationFrameIndex(FrameIndex))
-			return GetBoneTransformFast(SkeletonBoneIndex, FrameIndex);
-
-		ConditionalFlushDeferredTransitions(FrameIndex);
+		//instances never reference transition frames that aren't ready
 		return GetBoneTransformFast(SkeletonBoneIndex, FrameIndex);
 	}
 	return FTransform3f::Identity;
@@ -800,6 +800,9 @@ void USkelotAnimCollection::DestroyBuildData()
 {
 	check(IsInGameThread());
 
+	//background task reads the build data
+	CompleteTransitionGeneration(true);
+
 	AnimationBuffer = nullptr;
 	CurveBuffer = nullptr;
 
@@ -845,6 +848,12 @@ void USkelotAnimCollection::DestroyBuildData()
 	DeferredTransitions.Reset();
 	DeferredTransitions_FrameCount = 0;
 
+	CompositeDefs.Empty();
+	CompositeDefMap.Empty();
+
+	TransitionRelocations.Empty();
+	NumTransitionRelocated = NumTransitionAllocFailed = 0;
+
 	DynamicPoseAllocator.Empty();
 	DynamicPoseFlipFlags.Empty();
 
@@ -890,6 +899,36 @@ int USkelotAnimCollection::FindSequenceDef(const UAnimSequenceBase* Animation) c
 	return Sequences.IndexOfByPredicate([=](const FSkelotSequenceDef& Item){ return Item.Sequence == Animation; });
 }
 
+int32 USkelotAnimCollection::FindOrAddCompositeDef(const UAnimComposite* Composite)
+{
+	check(IsInGameThread());
+
+	if (const int32* ExistingIndex = CompositeDefMap.Find(Composite))
+		return *ExistingIndex;
+
+	const TArray<FAnimSegment>& Segments = Composite->AnimationTrack.AnimSegments;
+	if (Segments.Num() == 0 || CompositeDefs.Num() >= 0xFFff) //composite index is uint16
+		return -1;
+
+	FCompositeDef CompositeDef;
+	CompositeDef.Composite = Composite;
+	CompositeDef.SegmentStartTimes.Reserve(Segments.Num());
+	CompositeDef.SegmentSequences.Reserve(Segments.Num());
+	for (const FAnimSegment& Segment : Segments)
+	{
+		const int SeqDefIndex = FindSequenceDef(Segment.GetAnimReference());
+		if (SeqDefIndex == -1)
+			return -1;
+
+		CompositeDef.SegmentStartTimes.Add(Segment.StartPos);
+		CompositeDef.SegmentSequences.Add(static_cast<uint16>(SeqDefIndex));
+	}
+
+	const int32 CompositeDefIndex = CompositeDefs.Add(MoveTemp(CompositeDef));
+	CompositeDefMap.Add(Composite, CompositeDefIndex);
+	return CompositeDefIndex;
+}
+
 int USkelotAnimCollection::FindSequenceDefByPath(const FSoftObjectPath& AnimationPath) const
 {
 	return Sequences.IndexOfByPredicate([=](const FSkelotSequenceDef& Item) { return Item.Sequence && FSoftObjectPath(Item.Sequence) == AnimationPath; });
@@ -1020,6 +1059,7 @@ void USkelotAnimCollection::InitSkeletonData()
 			for (const FAnimNotifyEvent& Notify : SD.Sequence->Notifies)
 				ConvertNotification(Notify, SD);
 		}
+		SD.BuildNotifyFrames();
 	}
 
 	this->CachedTransforms.Empty();
@@ -1283,12 +1323,14 @@ bool USkelotAnimCollection::BuildAnimationData()
 	//LexToString(FUnitConversion::QuantizeUnitsToBestFit((this->RenderBoneCount * this->PoseCount * this->GetRenderMatrixSize()), EUnit::Bytes));
 
 	this->AnimationBuffer = MakeUnique<FSkelotAnimationBuffer>();
+	this->AnimationBuffer->bKeepCPUData = this->bBlendBakedTransitions;	//transitions are blended from it
 	this->AnimationBuffer->InitBuffer(this->RenderBoneCount * this->TotalFrameCount, this->UseHighPrecisionFormat(), true);
 
 	this->CurveBuffer = nullptr;
 	if (HasAnyCurve())
 	{	
 		this->CurveBuffer = MakeUnique<FSkelotCurveBuffer>();
+		this->CurveBuffer->Values.SetAllowCPUAccess(this->bBlendBakedTransitions);
 		this->CurveBuffer->InitBuffer(this->TotalFrameCount,  Align(this->CurvesToCache.Num(), 2));
 	}
 
@@ -1367,6 +1409,9 @@ void USkelotAnimCollection::BuildSequence(int SequenceIndex)
 	if (!AnimSeqBase)
 		return;
 
+	//baked at the pose sample rate so that playback doesn't decompress the sequence to extract root motion
+	SequenceStruct.BuildRootMotionTrack();
+
 
 	UAnimSequence_Public* AnimSeq = static_cast<UAnimSequence_Public*>(AnimSeqBase);
 	check(WITH_EDITOR || AnimSeq->IsCompressedDataValid());
@@ -1750,12 +1795,22 @@ void USkelotAnimCollection::RemoveUnusedTransition(SkelotTransitionIndex UnusedT
 
 void USkelotAnimCollection::RemoveAllUnusedTransitions()
 {
+	//transitions still waiting for generation are kept until they are ready
+	int32 NumKept = 0;
 	for (SkelotTransitionIndex UnusedTI : NegativeRCTransitions)
 	{
+		FTransition& T = this->Transitions[UnusedTI];
+		if (T.IsDeferred())
+		{
+			T.StateIndex = static_cast<SkelotTransitionIndex>(NumKept);
+			NegativeRCTransitions[NumKept++] = UnusedTI;
+			continue;
+		}
+
 		RemoveUnusedTransition(UnusedTI);
 	}
 	
-	NegativeRCTransitions.Reset();
+	NegativeRCTransitions.SetNum(NumKept, EAllowShrinking::No);
 }
 
 
@@ -1797,21 +1852,31 @@ TPair<int, USkelotAnimCollection::ETransitionResult> USkelotAnimCollection::Find
 		return { -1, ETR_Failed_RateLimitReached };
 
 	if (Transitions.Num() >= 0xFFff) //transition index is uint16
+	{
+		NumTransitionAllocFailed++;
 		return { -1, ETR_Failed_BufferFull };
+	}
 
 	int32 BlockOffset = AllocTransitionPose(Key.FrameCount);
 	if (BlockOffset == -1) //if pool is full free unused transitions 
 	{
-		while (NegativeRCTransitions.Num())
+		int32 StateIndex = NegativeRCTransitions.Num() - 1;
+		while (StateIndex >= 0)
 		{
-			//try remove several elements at once
-			int N = FMath::Min(8, NegativeRCTransitions.Num());
-			while (N > 0)
+			//try remove several elements at once. those waiting for generation can't be removed yet
+			for (int N = 0; N < 8 && StateIndex >= 0; StateIndex--)
 			{
-				SkelotTransitionIndex UnusedTransitionIndex = NegativeRCTransitions.Pop();
+				const SkelotTransitionIndex UnusedTransitionIndex = NegativeRCTransitions[StateIndex];
+				if (this->Transitions[UnusedTransitionIndex].IsDeferred())
+					continue;
+
+				NegativeRCTransitions.RemoveAtSwap(StateIndex, EAllowShrinking::No);
+				if (NegativeRCTransitions.IsValidIndex(StateIndex))
+					this->Transitions[NegativeRCTransitions[StateIndex]].StateIndex = static_cast<SkelotTransitionIndex>(StateIndex);
+
 				RemoveUnusedTransition(UnusedTransitionIndex);
-				N--;
-			};
+				N++;
+			}
 
 			BlockOffset = AllocTransitionPose(Key.FrameCount);
 			if (BlockOffset != -1)
@@ -1820,6 +1885,7 @@ TPair<int, USkelotAnimCollection::ETransitionResult> USkelotAnimCollection::Find
 		
 		if (BlockOffset == -1)
 		{
+			NumTransitionAllocFailed++;
 			return { -1, ETR_Failed_BufferFull };
 		}
 	}
@@ -1833,9 +1899,9 @@ TPair<int, USkelotAnimCollection::ETransitionResult> USkelotAnimCollection::Find
 	NewTransition.BlockOffset = BlockOffset;
 	NewTransition.FrameIndex = this->FrameCountSequences + BlockOffset;
 
-	//push it for concurrent end of frame generation
+	//push it for background generation, instances play the source pose until it's ready
 	//#Note CachedTransforms of the transitions contain invalid value
-	NewTransition.DeferredIndex = this->DeferredTransitions.Add(NewTransitionIndex);
+	this->DeferredTransitions.Add(static_cast<SkelotTransitionIndex>(NewTransitionIndex));
 	this->DeferredTransitions_FrameCount += Key.FrameCount;
 
 	this->TransitionsHashTable.Add(KeyHash, NewTransitionIndex);
@@ -1895,9 +1961,135 @@ void USkelotAnimCollection::ReleasePendingTransitions()
 
 }
 
-void USkelotAnimCollection::GenerateTransition_Concurrent(uint32 TransitionIndex, uint32 ScatterIdx)
+template<typename TMatrix3x4> static FMatrix44f SkelotMatrix3x4TransposeToMatrix44(const TMatrix3x4& Src)
+{
+	FMatrix44f Dst;
+	for (int Row = 0; Row < 3; Row++)
+	{
+		for (int Col = 0; Col < 4; Col++)
+			Dst.M[Col][Row] = static_cast<float>(Src.M[Row][Col]);
+	}
+	Dst.M[0][3] = Dst.M[1][3] = Dst.M[2][3] = 0;
+	Dst.M[3][3] = 1;
+	return Dst;
+}
+
+bool USkelotAnimCollection::CanBlendBakedTransition(const FTransition& Trs) const
+{
+	if (!this->AnimationBuffer || !this->AnimationBuffer->bKeepCPUData)
+		return false;
+
+	//curves are blended from their CPU copy too
+	if (this->CurveBuffer && this->CurveBuffer->NumCurve && !this->CurveBuffer->Values.GetData())
+		return false;
+
+	//source frames are stepped with the destination frequency
+	return this->Sequences[Trs.FromSI].SampleFrequency == this->Sequences[Trs.ToSI].SampleFrequency;
+}
+
+void USkelotAnimCollection::BlendBakedTransition_Concurrent(const FTransition& Trs, FPoseUploadData& UploadData, uint32 ScatterIdx)
 {
-	const FTransition& Trs = this->Transitions[TransitionIndex];
+	const FSkelotSequenceDef& SequenceStructFrom = this->Sequences[Trs.FromSI];
+	const FSkelotSequenceDef& SequenceStructTo = this->Sequences[Trs.ToSI];
+	const int TransitionFrameCount = Trs.FrameCount;
+	const int NumCurve = this->CurveBuffer ? this->CurveBuffer->NumCurve : 0;
+
+	INC_DWORD_STAT_BY(STAT_SKELOT_NumTransitionPoseGenerated, TransitionFrameCount);
+
+	const FMatrix3x4* MatricesHP = this->AnimationBuffer->bHighPrecision ? this->AnimationBuffer->GetDataPointerHP() : nullptr;
+	const FMatrix3x4Half* MatricesLP = !this->AnimationBuffer->bHighPrecision ? this->AnimationBuffer->GetDataPointerLP() : nullptr;
+	const FFloat16* CurveValues = NumCurve ? this->CurveBuffer->Values.GetData() : nullptr;
+
+	//baked matrices are RefPoseInverse * ComponentSpace. poses are blended in local space (relative to the closest rendered ancestor) like the runtime path,
+	//blending component space directly would shorten limbs when the rotations differ much
+	const FReferenceSkeleton& RefSkel = this->Skeleton->GetReferenceSkeleton();
+	TArray<int32> RenderBoneParents;
+	TArray<FMatrix44f> RefPoseMatrices;
+	RenderBoneParents.SetNumUninitialized(this->RenderBoneCount);
+	RefPoseMatrices.SetNumUninitialized(this->RenderBoneCount);
+	for (int BoneIndex = 0; BoneIndex < this->RenderBoneCount; BoneIndex++)
+	{
+		const FBoneIndexType SkelBoneIndex = this->RenderRequiredBones[BoneIndex];
+		int32 ParentIndex = RefSkel.GetParentIndex(SkelBoneIndex);
+		while (ParentIndex != INDEX_NONE && this->SkeletonBoneToRenderBone[ParentIndex] == -1)
+			ParentIndex = RefSkel.GetParentIndex(ParentIndex);
+
+		//render bones are sorted by skeleton index so parents always come first
+		RenderBoneParents[BoneIndex] = ParentIndex != INDEX_NONE ? this->SkeletonBoneToRenderBone[ParentIndex] : -1;
+		RefPoseMatrices[BoneIndex] = static_cast<FTransform3f>(this->RefPoseComponentSpace[SkelBoneIndex]).ToMatrixWithScale();
+	}
+
+	TArray<FTransform3f> FromComponent, ToComponent, BlendedComponent;
+	FromComponent.SetNumUninitialized(this->RenderBoneCount);
+	ToComponent.SetNumUninitialized(this->RenderBoneCount);
+	BlendedComponent.SetNumUninitialized(this->RenderBoneCount);
+
+	for (int TransitionFrameIndex = 0; TransitionFrameIndex < TransitionFrameCount; TransitionFrameIndex++)
+	{
+		//same frames and weights the runtime path samples
+		int FromLFI = Trs.FromFI + TransitionFrameIndex;
+		FromLFI = Trs.bFromLoops ? FromLFI % SequenceStructFrom.AnimationFrameCount : FMath::Min(FromLFI, SequenceStructFrom.AnimationFrameCount - 1);
+		const int FromFrameIndex = SequenceStructFrom.AnimationFrameIndex + FromLFI;
+		const int ToFrameIndex = SequenceStructTo.AnimationFrameIndex + Trs.ToFI + TransitionFrameIndex;
+		const int TransitionPoseIndex = Trs.FrameIndex + TransitionFrameIndex;
+
+		const float TransitionAlpha = (TransitionFrameIndex + 1) / static_cast<float>(TransitionFrameCount + 1);
+		const float FinalAlpha = FAlphaBlend::AlphaToBlendOption(TransitionAlpha, Trs.BlendOption);
+
+		UploadData.ScatterData[ScatterIdx + TransitionFrameIndex] = static_cast<uint32>(TransitionPoseIndex);
+		FMatrix3x4* UploadMatrices = &UploadData.PoseData[(ScatterIdx + TransitionFrameIndex) * this->RenderBoneCount];
+
+		//back to component space, blend the local transforms and recompose. FTransform3f math is vectorized
+		for (int BoneIndex = 0; BoneIndex < this->RenderBoneCount; BoneIndex++)
+		{
+			const int FromMatrixIndex = FromFrameIndex * this->RenderBoneCount + BoneIndex;
+			const int ToMatrixIndex = ToFrameIndex * this->RenderBoneCount + BoneIndex;
+			FromComponent[BoneIndex] = FTransform3f(RefPoseMatrices[BoneIndex] * (MatricesHP ? SkelotMatrix3x4TransposeToMatrix44(MatricesHP[FromMatrixIndex]) : SkelotMatrix3x4TransposeToMatrix44(MatricesLP[FromMatrixIndex])));
+			ToComponent[BoneIndex] = FTransform3f(RefPoseMatrices[BoneIndex] * (MatricesHP ? SkelotMatrix3x4TransposeToMatrix44(MatricesHP[ToMatrixIndex]) : SkelotMatrix3x4TransposeToMatrix44(MatricesLP[ToMatrixIndex])));
+
+			const int32 ParentIndex = RenderBoneParents[BoneIndex];
+			FTransform3f Blended;
+			if (ParentIndex != -1)
+			{
+				Blended.Blend(FromComponent[BoneIndex].GetRelativeTransform(FromComponent[ParentIndex]), ToComponent[BoneIndex].GetRelativeTransform(ToComponent[ParentIndex]), FinalAlpha);
+				Blended = Blended * BlendedComponent[ParentIndex];
+			}
+			else
+			{
+				Blended.Blend(FromComponent[BoneIndex], ToComponent[BoneIndex], FinalAlpha);
+			}
+
+			BlendedComponent[BoneIndex] = Blended;
+			SkelotSetMatrix3x4Transpose(UploadMatrices[BoneIndex], this->RefPoseInverse[this->RenderRequiredBones[BoneIndex]] * Blended.ToMatrixWithScale());
+		}
+
+		for (FBoneIndexType SkelBoneIndex : this->BonesToCache_Indices)
+		{
+			FTransform3f& BoneT = this->GetBoneTransformFast(SkelBoneIndex, TransitionPoseIndex);
+			const int RenderBoneIndex = this->SkeletonBoneToRenderBone[SkelBoneIndex];
+			if (RenderBoneIndex != -1)
+				BoneT = BlendedComponent[RenderBoneIndex];
+			else
+				BoneT.Blend(this->GetBoneTransformFast(SkelBoneIndex, FromFrameIndex), this->GetBoneTransformFast(SkelBoneIndex, ToFrameIndex), FinalAlpha);
+		}
+
+		if (CurveValues)
+		{
+			FFloat16* UploadCurves = &UploadData.CurvesValue[(ScatterIdx + TransitionFrameIndex) * NumCurve];
+			for (int i = 0; i < NumCurve; i++)
+				UploadCurves[i] = FMath::Lerp(static_cast<float>(CurveValues[FromFrameIndex * NumCurve + i]), static_cast<float>(CurveValues[ToFrameIndex * NumCurve + i]), FinalAlpha);
+		}
+	}
+}
+
+void USkelotAnimCollection::GenerateTransition_Concurrent(const FTransition& Trs, FPoseUploadData& UploadData, uint32 ScatterIdx)
+{
+	if (CanBlendBakedTransition(Trs))
+	{
+		BlendBakedTransition_Concurrent(Trs, UploadData, ScatterIdx);
+		return;
+	}
+
 	const FSkelotSequenceDef& SequenceStructFrom = this->Sequences[Trs.FromSI];
 	const FSkelotSequenceDef& SequenceStructTo = this->Sequences[Trs.ToSI];
 
@@ -1908,10 +2100,10 @@ void USkelotAnimCollection::GenerateTransition_Concurrent(uint32 TransitionIndex
 	INC_DWORD_STAT_BY(STAT_SKELOT_NumTransitionPoseGenerated, TransitionFrameCount);
 
 	for (int i = 0; i < TransitionFrameCount; i++)
-		this->CurrentUpload.ScatterData[ScatterIdx + i] = static_cast<uint32>(Trs.FrameIndex + i);
+		UploadData.ScatterData[ScatterIdx + i] = static_cast<uint32>(Trs.FrameIndex + i);
 
-	FMatrix3x4* UploadMatrices = &this->CurrentUpload.PoseData[ScatterIdx * this->RenderBoneCount];
-	FFloat16* UploadCurves = this->CurveBuffer ? &this->CurrentUpload.CurvesValue[ScatterIdx * this->CurveBuffer->NumCurve] : nullptr;
+	FMatrix3x4* UploadMatrices = &UploadData.PoseData[ScatterIdx * this->RenderBoneCount];
+	FFloat16* UploadCurves = this->CurveBuffer ? &UploadData.CurvesValue[ScatterIdx * this->CurveBuffer->NumCurve] : nullptr;
 
 	FMemMark MemMarker(FMemStack::Get());
 
@@ -1971,6 +2163,8 @@ void USkelotAnimCollection::FlushDeferredTransitions()
 	check(IsInGameThread());
 	SKELOT_SCOPE_CYCLE_COUNTER(USkelotAnimCollection_FlushDeferredTransitions);
 
+	CompleteTransitionGeneration(true);
+
 	if (this->DeferredTransitions.Num())
 	{
 		FMemMark MemMarker(FMemStack::Get());
@@ -1981,13 +2175,13 @@ void USkelotAnimCollection::FlushDeferredTransitions()
 		{
 			FTransition& T = this->Transitions[DeferredTransitions[i]];
 			check(T.IsDeferred());
-			T.DeferredIndex = -1;
+			T.bReady = true;
 			ScatterIndices[i] = ScatterIdx;
 			ScatterIdx += T.FrameCount;
 		}
 
 		ParallelFor(DeferredTransitions.Num(), [this, ScatterIndices](int Index) {
-			this->GenerateTransition_Concurrent(this->DeferredTransitions[Index], ScatterIndices[Index]);
+			this->GenerateTransition_Concurrent(this->Transitions[this->DeferredTransitions[Index]], this->CurrentUpload, ScatterIndices[Index]);
 		});
 
 		this->DeferredTransitions.Reset();
@@ -1996,6 +2190,187 @@ void USkelotAnimCollection::FlushDeferredTransitions()
 	
 }
 
+void USkelotAnimCollection::LaunchTransitionGeneration()
+{
+	check(IsInGameThread());
+
+	if (this->DeferredTransitions.Num() == 0 || this->TransitionGeneration.Jobs.Num())
+		return;
+
+	SKELOT_SCOPE_CYCLE_COUNTER(USkelotAnimCollection_LaunchTransitionGeneration);
+
+	FTransitionGeneration& Gen = this->TransitionGeneration;
+	FPoseUploadData& UploadData = Gen.UploadData;
+	UploadData.ScatterData.SetNumUninitialized(this->DeferredTransitions_FrameCount);
+	UploadData.PoseData.SetNumUninitialized(this->DeferredTransitions_FrameCount * this->RenderBoneCount);
+	if (this->CurveBuffer)
+		UploadData.CurvesValue.SetNumUninitialized(this->DeferredTransitions_FrameCount * this->CurveBuffer->NumCurve);
+
+	int ScatterIdx = 0;
+	Gen.Jobs.Reserve(this->DeferredTransitions.Num());
+	for (SkelotTransitionIndex TransitionIndex : this->DeferredTransitions)
+	{
+		const FTransition& T = this->Transitions[TransitionIndex];
+		Gen.Jobs.Add(FTransitionGenerationJob{ T, TransitionIndex, ScatterIdx, false });
+		ScatterIdx += T.FrameCount;
+	}
+
+	this->DeferredTransitions.Reset();
+	this->DeferredTransitions_FrameCount = 0;
+
+	const double BudgetSeconds = GSkelot_TransitionGenerationBudgetMS / 1000.0;
+	Gen.Task = UE::Tasks::Launch(UE_SOURCE_LOCATION, [this, BudgetSeconds]() {
+		
+		SKELOT_SCOPE_CYCLE_COUNTER(USkelotAnimCollection_TransitionGenerationTask);
+		const double EndTime = FPlatformTime::Seconds() + BudgetSeconds;
+
+		ParallelFor(this->TransitionGeneration.Jobs.Num(), [this, EndTime](int Index) {
+			//out of budget, left for the next task
+			if (FPlatformTime::Seconds() > EndTime)
+				return;
+
+			FTransitionGenerationJob& Job = this->TransitionGeneration.Jobs[Index];
+			this->GenerateTransition_Concurrent(Job.Transition, this->TransitionGeneration.UploadData, Job.ScatterIdx);
+			Job.bDone = true;
+
+		}, EParallelForFlags::BackgroundPriority);
+
+	}, UE::Tasks::ETaskPriority::BackgroundNormal);
+}
+
+bool USkelotAnimCollection::CompleteTransitionGeneration(bool bWait)
+{
+	check(IsInGameThread());
+
+	FTransitionGeneration& Gen = this->TransitionGeneration;
+	if (Gen.Jobs.Num() == 0)
+		return true;
+
+	if (!bWait && !Gen.Task.IsCompleted())
+		return false;
+
+	SKELOT_SCOPE_CYCLE_COUNTER(USkelotAnimCollection_CompleteTransitionGeneration);
+	Gen.Task.Wait();
+
+	const int NumCurve = this->CurveBuffer ? this->CurveBuffer->NumCurve : 0;
+	TArray<SkelotTransitionIndex> Unfinished;
+	uint32 UnfinishedFrameCount = 0;
+
+	for (const FTransitionGenerationJob& Job : Gen.Jobs)
+	{
+		const int FrameCount = Job.Transition.FrameCount;
+		if (!Job.bDone)
+		{
+			Unfinished.Add(Job.TransitionIndex);
+			UnfinishedFrameCount += FrameCount;
+			continue;
+		}
+
+		const int DstIdx = ReserveUploadData(FrameCount);
+		FMemory::Memcpy(&CurrentUpload.ScatterData[DstIdx], &Gen.UploadData.ScatterData[Job.ScatterIdx], FrameCount * sizeof(uint32));
+		FMemory::Memcpy(&CurrentUpload.PoseData[DstIdx * RenderBoneCount], &Gen.UploadData.PoseData[Job.ScatterIdx * RenderBoneCount], FrameCount * RenderBoneCount * sizeof(FMatrix3x4));
+		if (NumCurve)
+			FMemory::Memcpy(&CurrentUpload.CurvesValue[DstIdx * NumCurve], &Gen.UploadData.CurvesValue[Job.ScatterIdx * NumCurve], FrameCount * NumCurve * sizeof(FFloat16));
+
+		FTransition& T = this->Transitions[Job.TransitionIndex];
+		check(T.IsDeferred());
+		T.bReady = true;
+	}
+
+	//unfinished ones go first so that they are not starved by new ones
+	if (Unfinished.Num())
+	{
+		this->DeferredTransitions.Insert(Unfinished, 0);
+		this->DeferredTransitions_FrameCount += UnfinishedFrameCount;
+	}
+
+	Gen.Jobs.Reset();
+	Gen.Task = UE::Tasks::FTask();
+	return true;
+}
+
+void USkelotAnimCollection::DefragTransitionPool()
+{
+	check(IsInGameThread());
+
+	//may be called several times a frame
+	if (this->TransitionRelocationFrame == GFrameCounter)
+		return;
+
+	//proxies sent before the last pass may have drawn the old ranges in that frame, nothing refers to them anymore
+	for (const FTransitionRelocation& Relocation : this->TransitionRelocations)
+		this->TransitionPoseAllocator.Free(Relocation.OldFrameIndex - this->FrameCountSequences, Relocation.FrameCount);
+
+	this->TransitionRelocations.Reset();
+
+	const int32 HighWater = this->TransitionPoseAllocator.GetMaxSize();
+	const int32 NumAllocated = this->TransitionPoseAllocator.GetSparselyAllocatedSize();
+	if (GSkelot_TransitionDefragMaxMoves <= 0 || HighWater == 0 || (1.0f - NumAllocated / static_cast<float>(HighWater)) <= GSkelot_TransitionDefragThreshold)
+		return;
+
+	SKELOT_SCOPE_CYCLE_COUNTER(USkelotAnimCollection_DefragTransitionPool);
+
+	//ready transitions from the highest range down. those waiting for generation are moved once they are ready
+	TArray<TPair<uint32, SkelotTransitionIndex>, TInlineAllocator<256>> Candidates;
+	for (auto Iter = this->Transitions.CreateConstIterator(); Iter; ++Iter)
+	{
+		if (!Iter->IsDeferred() && CanBlendBakedTransition(*Iter))
+			Candidates.Emplace(Iter->BlockOffset, static_cast<SkelotTransitionIndex>(Iter.GetIndex()));
+	}
+	Candidates.Sort([](const TPair<uint32, SkelotTransitionIndex>& A, const TPair<uint32, SkelotTransitionIndex>& B) { return A.Key > B.Key; });
+
+	this->TransitionPoseAllocator.Consolidate();
+
+	for (const TPair<uint32, SkelotTransitionIndex>& Candidate : Candidates)
+	{
+		if (this->TransitionRelocations.Num() >= GSkelot_TransitionDefragMaxMoves)
+			break;
+
+		FTransition& T = this->Transitions[Candidate.Value];
+		const int32 NewBlockOffset = this->TransitionPoseAllocator.Allocate(T.FrameCount);
+		if (NewBlockOffset >= static_cast<int32>(T.BlockOffset)) //no lower hole that fits
+		{
+			this->TransitionPoseAllocator.Free(NewBlockOffset, T.FrameCount);
+			continue;
+		}
+
+		this->TransitionRelocations.Add(FTransitionRelocation{ T.FrameIndex, this->FrameCountSequences + NewBlockOffset, T.FrameCount });
+		T.BlockOffset = NewBlockOffset;
+		T.FrameIndex = this->FrameCountSequences + NewBlockOffset;
+
+		//only the moved range is uploaded
+		GenerateTransition_Concurrent(T, this->CurrentUpload, ReserveUploadData(T.FrameCount));
+	}
+
+	this->TransitionRelocationFrame = GFrameCounter;
+	this->NumTransitionRelocated += this->TransitionRelocations.Num();
+
+	//instances hold frame indices (LOD or significance skipped ones for several frames), every world using this collection is remapped now.
+	//running before the old ranges can be reallocated keeps it safe with several worlds per engine tick (PIE server + clients, editor + PIE)
+	if (this->TransitionRelocations.Num())
+	{
+		for (TObjectIterator<ASkelotWorld> Iter; Iter; ++Iter)
+		{
+			if (IsValid(*Iter) && !Iter->IsTemplate() && Iter->GetWorld())
+				Iter->RemapRelocatedTransitionFrames(this);
+		}
+	}
+}
+
+FSkelotTransitionPoolStats USkelotAnimCollection::GetTransitionPoolStats() const
+{
+	FSkelotTransitionPoolStats Stats;
+	Stats.NumTransition = this->Transitions.Num();
+	Stats.NumFrameAllocated = this->TransitionPoseAllocator.GetSparselyAllocatedSize();
+	Stats.HighWater = this->TransitionPoseAllocator.GetMaxSize();
+	Stats.Capacity = this->MaxTransitionPose;
+	Stats.Occupancy = Stats.Capacity > 0 ? Stats.NumFrameAllocated / static_cast<float>(Stats.Capacity) : 0;
+	Stats.Fragmentation = Stats.HighWater > 0 ? 1.0f - Stats.NumFrameAllocated / static_cast<float>(Stats.HighWater) : 0;
+	Stats.NumRelocated = this->NumTransitionRelocated;
+	Stats.NumAllocationFailed = this->NumTransitionAllocFailed;
+	return Stats;
+}
+
 void USkelotAnimCollection::ApplyScatterBufferRT(FRHICommandList& RHICmdList, const FPoseUploadData& UploadData)
 {
 	check(IsInRenderingThread());
@@ -2138,6 +2513,113 @@ int FSkelotSequenceDef::CalcFrameCount() const
 	return MaxFrame;
 }
 
+void FSkelotSequenceDef::BuildNotifyFrames()
+{
+	NotifyFrames.Reset(Notifies.Num());
+	if (!Sequence)
+		return;
+
+	const int32 FrameCount = CalcFrameCount();
+	for (int32 NotifyIndex = 0; NotifyIndex < Notifies.Num(); NotifyIndex++)
+	{
+		const FSkelotAnimNotifyDesc& Desc = Notifies[NotifyIndex];
+		if (Desc.TriggerChance <= 0)
+			continue;
+
+		FSkelotNotifyFrame& NotifyFrame = NotifyFrames.AddDefaulted_GetRef();
+		//same rounding as the frame index used for playback, see CalcFrameIndex
+		NotifyFrame.Frame = FMath::Clamp(static_cast<int32>(Desc.Time * SampleFrequency), 0, FrameCount - 1);
+		NotifyFrame.NotifyIndex = NotifyIndex;
+		NotifyFrame.ChanceThreshold = Desc.TriggerChance >= 1 ? MAX_uint32 : static_cast<uint32>(static_cast<double>(Desc.TriggerChance) * MAX_uint32);
+	}
+
+	Algo::StableSortBy(NotifyFrames, &FSkelotNotifyFrame::Frame);
+}
+
+void FSkelotSequenceDef::BuildRootMotionTrack()
+{
+	RootMotionTrack.Reset();
+	if (!Sequence || !Sequence->HasRootMotion() || AnimationFrameCount <= 0)
+		return;
+
+	const double Length = Sequence->GetPlayLength();
+	RootMotionTrack.SetNumUninitialized(AnimationFrameCount + 1);
+	for (int32 SampleIndex = 0; SampleIndex <= AnimationFrameCount; SampleIndex++)
+	{
+		const double SampleTime = SampleIndex < AnimationFrameCount ? FMath::Min(SampleIndex / static_cast<double>(SampleFrequency), Length) : Length;
+		const FTransform RootMotion = Sequence->ExtractRootMotionFromRange(0, SampleTime, FAnimExtractContext());
+
+		FSkelotRootMotionSample& Sample = RootMotionTrack[SampleIndex];
+		Sample.Translation = FVector3f(RootMotion.GetTranslation());
+		Sample.Yaw = FMath::DegreesToRadians(static_cast<float>(RootMotion.Rotator().Yaw));
+		//unwind so that neighbour samples never differ by more than half a turn
+		if (SampleIndex > 0)
+			Sample.Yaw = RootMotionTrack[SampleIndex - 1].Yaw + FMath::UnwindRadians(Sample.Yaw - RootMotionTrack[SampleIndex - 1].Yaw);
+	}
+}
+
+FSkelotRootMotionSample FSkelotSequenceDef::EvaluateRootMotion(float Time) const
+{
+	const int32 NumSample = RootMotionTrack.Num();
+	check(NumSample >= 2);
+
+	//last interval ends at sequence length instead of the next frame
+	const float LastFrameTime = (NumSample - 2) / static_cast<float>(SampleFrequency);
+	int32 SampleIndex;
+	float Alpha;
+	if (Time >= LastFrameTime)
+	{
+		SampleIndex = NumSample - 2;
+		const float LastInterval = Sequence->GetPlayLength() - LastFrameTime;
+		Alpha = LastInterval > UE_KINDA_SMALL_NUMBER ? FMath::Min((Time - LastFrameTime) / LastInterval, 1.0f) : 1.0f;
+	}
+	else
+	{
+		const float SamplePos = FMath::Max(Time, 0.0f) * SampleFrequency;
+		SampleIndex = FMath::TruncToInt32(SamplePos);
+		Alpha = SamplePos - SampleIndex;
+	}
+
+	const FSkelotRootMotionSample& A = RootMotionTrack[SampleIndex];
+	const FSkelotRootMotionSample& B = RootMotionTrack[SampleIndex + 1];
+	return FSkelotRootMotionSample{ FMath::Lerp(A.Translation, B.Translation, Alpha), FMath::Lerp(A.Yaw, B.Yaw, Alpha) };
+}
+
+FTransform3f FSkelotSequenceDef::ExtractBakedRootMotion(float StartTime, float DeltaTime, bool bLooping) const
+{
+	auto ExtractRange = [this](float From, float To) {
+		const FSkelotRootMotionSample A = EvaluateRootMotion(From);
+		const FSkelotRootMotionSample B = EvaluateRootMotion(To);
+		//delta expressed in the space of the instance at From
+		const FQuat4f InvRotA(FVector3f::UpVector, -A.Yaw);
+		return FTransform3f(FQuat4f(FVector3f::UpVector, B.Yaw - A.Yaw), InvRotA.RotateVector(B.Translation - A.Translation));
+	};
+
+	const float Length = Sequence->GetPlayLength();
+	const float EndTime = StartTime + DeltaTime;
+	if ((EndTime >= 0 && EndTime <= Length) || !bLooping)
+		return ExtractRange(StartTime, FMath::Clamp(EndTime, 0.0f, Length));
+
+	//wrapped, same accumulation order as FRootMotionMovementParams::Accumulate. negative delta wraps from start to end
+	const bool bForward = EndTime > Length;
+	FTransform3f Result = ExtractRange(StartTime, bForward ? Length : 0.0f);
+	if (Length <= UE_KINDA_SMALL_NUMBER)
+		return Result;
+
+	//a large (e.g accumulated) delta may wrap several times, each complete cycle adds the motion of the whole track
+	const float Remaining = bForward ? EndTime - Length : -EndTime;
+	const int32 NumCycles = FMath::FloorToInt32(Remaining / Length);
+	if (NumCycles > 0)
+	{
+		const FTransform3f Cycle = bForward ? ExtractRange(0, Length) : ExtractRange(Length, 0);
+		for (int32 CycleIndex = 0; CycleIndex < NumCycles; CycleIndex++)
+			Result = Cycle * Result;
+	}
+
+	const float WrappedTime = Remaining - NumCycles * Length;
+	return (bForward ? ExtractRange(0, WrappedTime) : ExtractRange(Length, Length - WrappedTime)) * Result;
+}
+
 void FSkelotCompactPhysicsAsset::Init(const USkeleton* Skeleton, const UPhysicsAsset* PhysAsset)
 {
 	for (const USkeletalBodySetup* Body : PhysAsset->SkeletalBodySetups)
@@ -2306,7 +2788,18 @@ void FSkelotCompactPhysicsAsset::Raycast(FRaycastParams& Params) const
 
 void USkelotAnimCollection::OnPreSendAllEndOfFrameUpdates(UWorld* World)
 {
-	FlushDeferredTransitions();
+	DefragTransitionPool();
+
+	//poses of ready transitions are uploaded with this frame, instances start using them from the next frame
+	if (GSkelot_TransitionGenerationBudgetMS > 0)
+	{
+		CompleteTransitionGeneration(false);
+		LaunchTransitionGeneration();
+	}
+	else
+	{
+		FlushDeferredTransitions();
+	}
 
 	if (this->CurrentUpload.ScatterData.Num())
 	{
@@ -2343,7 +2836,7 @@ void USkelotAnimCollection::ConvertNotification(const FAnimNotifyEvent& Notify /
 	
 	if (ISkelotNotifyInterface* AsSkelotInterface = Cast<ISkelotNotifyInterface>(Notify.Notify))
 	{
-		SequenceDef.Notifies.Emplace(FSkelotAnimNotifyDesc{ Notify.GetTriggerTime(), Notify.NotifyName, Notify.Notify, AsSkelotInterface });
+		SequenceDef.Notifies.Emplace(FSkelotAnimNotifyDesc{ Notify.GetTriggerTime(), Notify.NotifyName, Notify.Notify, AsSkelotInterface, Notify.NotifyTriggerChance });
 		return;
 	}
 
@@ -2352,7 +2845,7 @@ void USkelotAnimCollection::ConvertNotification(const FAnimNotifyEvent& Notify /
 	{
 		UAnimNotify_SkelotPlaySound* SkelotNotify = NewObject<UAnimNotify_SkelotPlaySound>();
 		UEngine::CopyPropertiesForUnrelatedObjects(AsPlaySound, SkelotNotify);
-		SequenceDef.Notifies.Emplace(FSkelotAnimNotifyDesc{ Notify.GetTriggerTime(), Notify.NotifyName, SkelotNotify, Cast<ISkelotNotifyInterface>(SkelotNotify) });
+		SequenceDef.Notifies.Emplace(FSkelotAnimNotifyDesc{ Notify.GetTriggerTime(), Notify.NotifyName, SkelotNotify, Cast<ISkelotNotifyInterface>(SkelotNotify), Notify.NotifyTriggerChance });
 		return;
 	}
 
@@ -2361,13 +2854,13 @@ void USkelotAnimCollection::ConvertNotification(const FAnimNotifyEvent& Notify /
 	{
 		UAnimNotify_SkelotPlayNiagaraEffect* SkelotNotify = NewObject<UAnimNotify_SkelotPlayNiagaraEffect>();
 		UEngine::CopyPropertiesForUnrelatedObjects(AsPlayNiagara, SkelotNotify);
-		SequenceDef.Notifies.Emplace(FSkelotAnimNotifyDesc{ Notify.GetTriggerTime(), Notify.NotifyName, SkelotNotify, Cast<ISkelotNotifyInterface>(SkelotNotify) });
+		SequenceDef.Notifies.Emplace(FSkelotAnimNotifyDesc{ Notify.GetTriggerTime(), Notify.NotifyName, SkelotNotify, Cast<ISkelotNotifyInterface>(SkelotNotify), Notify.NotifyTriggerChance });
 		return;
 	}
 
 	if (Notify.NotifyStateClass == nullptr && Notify.Notify == nullptr) //name only notification ?
 	{
-		SequenceDef.Notifies.Emplace(FSkelotAnimNotifyDesc{ Notify.GetTriggerTime(), Notify.NotifyName, nullptr, nullptr });
+		SequenceDef.Notifies.Emplace(FSkelotAnimNotifyDesc{ Notify.GetTriggerTime(), Notify.NotifyName, nullptr, nullptr, Notify.NotifyTriggerChance });
 		return;
 	}
 
@@ -43,15 +43,18 @@ FBoxSphereBounds USKelotClusterComponent::ComputeBoundWS() const
 	if (ClusterRef.Instances.Num() == 0)
 		return FBoxSphereBounds(ForceInit);
 
-	FBox LocalBound = CalcApproximateLocalBound();
-	LocalBound.IsValid = true;
-
-	FBox Bound(ForceInit);
-
-	const ASkelotWorld* SKW = GetSkelotWorld();
-	for (int32 InstanceIdx : ClusterRef.Instances)
+	//maintained by ASkelotWorld every frame, only invalid if cluster was just created
+	FBox Bound = ClusterRef.Bounds;
+	if (!Bound.IsValid)
 	{
-		Bound += LocalBound.TransformBy(SKW->GetInstanceTransform(InstanceIdx));
+		FBox LocalBound = CalcApproximateLocalBound();
+		LocalBound.IsValid = true;
+
+		const ASkelotWorld* SKW = GetSkelotWorld();
+		for (int32 InstanceIdx : ClusterRef.Instances)
+		{
+			Bound += LocalBound.TransformBy(SKW->GetInstanceTransform(InstanceIdx));
+		}
 	}
 
 	FBoxSphereBounds BS(Bound);
@@ -298,13 +301,10 @@ void USKelotClusterComponent::SendRenderDynamicData_Concurrent()
 		const uint32 NumSubMesh = GetRenderDesc().Meshes.Num();
 
 		//count how many times a sub mesh is being used  ---------------
-		uint32 SubMeshCounts[64] = { };
+		uint32 SubMeshCounts[FSkelotSubmeshMask::MaxSubmesh] = { };
 		for (int32 InstanceIdx : ClusterRef.Instances)
 		{
-			for (uint8* SMIIter = SKWorld->GetInstanceSubmeshIndices(InstanceIdx); *SMIIter != 0xFF; SMIIter++)
-			{
-				SubMeshCounts[*SMIIter]++;
-			}
+			SKWorld->GetInstanceSubmeshMask(InstanceIdx).ForEach([&](uint8 SMI) { SubMeshCounts[SMI]++; });
 		}
 
 		for (uint32& Count : SubMeshCounts)
@@ -322,10 +322,7 @@ void USKelotClusterComponent::SendRenderDynamicData_Concurrent()
 			TmpInstances[DrawIdx].Index = InstanceIdx;
 			TmpInstances[DrawIdx].Value = 0;
 
-			for (uint8* SMIIter = SKWorld->GetInstanceSubmeshIndices(InstanceIdx); *SMIIter != 0xFF; SMIIter++)
-			{
-				TmpInstances[DrawIdx].Value += SubMeshCounts[*SMIIter];
-			}
+			SKWorld->GetInstanceSubmeshMask(InstanceIdx).ForEach([&](uint8 SMI) { TmpInstances[DrawIdx].Value += SubMeshCounts[SMI]; });
 		}
 
 		RadixSort32(ClusterRef.SortedInstances.GetData(), TmpInstances.GetData(), ClusterRef.Instances.Num(), [](FInstanceIndexAndSortKey In) { return In.Value; });
@@ -337,45 +334,34 @@ void USKelotClusterComponent::SendRenderDynamicData_Concurrent()
 		{
 			int32 StartIdx = -1;
 		};
-		FRangeData RangesData[0xFF];
+		FRangeData RangesData[FSkelotSubmeshMask::MaxSubmesh];
 
+		//only sub meshes that differ from the previous item start or end a range
+		FSkelotSubmeshMask PrevMask;
 		for (int32 ItemIdx = 0; ItemIdx < ClusterRef.SortedInstances.Num(); ItemIdx++)
 		{
-			bool HasSMI[0xff] = {};
+			const FSkelotSubmeshMask& CurMask = SKWorld->GetInstanceSubmeshMask(ClusterRef.SortedInstances[ItemIdx].Index);
+			if (CurMask == PrevMask)
+				continue;
 
-			for (uint8* SMIIter = SKWorld->GetInstanceSubmeshIndices(ClusterRef.SortedInstances[ItemIdx].Index); *SMIIter != 0xFF; SMIIter++)
-			{
-				const uint8 SMI = *SMIIter;
-				HasSMI[SMI] = true;
-				if (RangesData[SMI].StartIdx == -1)
-				{
-					RangesData[SMI].StartIdx = ItemIdx; // Start a new range
-				}
-			}
+			(CurMask & ~PrevMask).ForEach([&](uint8 SMI) {
+				RangesData[SMI].StartIdx = ItemIdx; // Start a new range
+			});
 
-			for (uint32 SMI = 0; SMI < NumSubMesh; SMI++)
-			{
-				if (!HasSMI[SMI])
-				{
-					if (RangesData[SMI].StartIdx != -1)
-					{
-						// End the current range
-						ClusterRef.InstanceRunRanges[SMI].Add(FInstanceRunData{ RangesData[SMI].StartIdx, ItemIdx - 1 });
-						RangesData[SMI].StartIdx = -1;
-					}
-				}
-			}
-		}
+			(PrevMask & ~CurMask).ForEach([&](uint8 SMI) {
+				// End the current range
+				ClusterRef.InstanceRunRanges[SMI].Add(FInstanceRunData{ RangesData[SMI].StartIdx, ItemIdx - 1 });
+				RangesData[SMI].StartIdx = -1;
+			});
 
-		for (uint32 SMI = 0; SMI < NumSubMesh; SMI++)
-		{
-			// Handle case where a range extends to the end of the array
-			if (RangesData[SMI].StartIdx != -1)
-			{
-				ClusterRef.InstanceRunRanges[SMI].Add(FInstanceRunData{ RangesData[SMI].StartIdx, ClusterRef.SortedInstances.Num() - 1 });
-			}
+			PrevMask = CurMask;
 		}
 
+		// Handle case where a range extends to the end of the array
+		PrevMask.ForEach([&](uint8 SMI) {
+			ClusterRef.InstanceRunRanges[SMI].Add(FInstanceRunData{ RangesData[SMI].StartIdx, ClusterRef.SortedInstances.Num() - 1 });
+		});
+
 #if !(UE_BUILD_SHIPPING || UE_BUILD_TEST)	//lets find out average instance count of sub meshes
 		ClusterRef.InstanceRun_AvgInstanceCount.Reset();
 		ClusterRef.InstanceRun_AvgInstanceCount.SetNumZeroed(NumSubMesh);
@@ -412,10 +398,11 @@ void USKelotClusterComponent::SendRenderDynamicData_Concurrent()
 		if (GSkelot_ForcedAnimFrameIndex != -1)
 			*PayloadFrame = FSkelotInstancesSOA::FAnimFrame{ GSkelot_ForcedAnimFrameIndex, GSkelot_ForcedAnimFrameIndex };
 
-		//copy user floats
+		//copy user floats, null if custom data is sparse and never set for this instance
+		const float* UserFloats = SKWorld->SOA.PerInstanceCustomData.Find(InstanceIndex);
 		for (int32 i = 0; i < DescNumFloatPerInstance; i++)
 		{
-			DynData->CustomData[RenderIndex * PayloadNumFloatPerInstance + i + 2] = SKWorld->SOA.PerInstanceCustomData[InstanceIndex * SKWorld->SOA.MaxNumCustomDataFloat + i];
+			DynData->CustomData[RenderIndex * PayloadNumFloatPerInstance + i + 2] = UserFloats ? UserFloats[i] : 0.0f;
 		}
 
 		FTransform InsT = SKWorld->GetInstanceTransform(InstanceIndex);
@@ -0,0 +1,60 @@
+// Copyright 2024 Lazy Marmot Games. All Rights Reserved.
+
+#include "SkelotCommandBuffer.h"
+#include "SkelotPrivate.h"
+
+void FSkelotCommandBuffer::CreateInstance(const FTransform& Transform, USkelotRenderParams* RenderParams, const FSkelotAnimPlayParams* AnimParams)
+{
+	FCreateCmd& Cmd = Creates.AddDefaulted_GetRef();
+	Cmd.Transform = Transform;
+	Cmd.RenderParams = RenderParams;
+	if (AnimParams)
+		Cmd.AnimIndex = CreateAnimParams.Add(*AnimParams);
+}
+
+void FSkelotCommandBuffer::DestroyInstance(FSkelotInstanceHandle Handle)
+{
+	Destroys.Add(Handle);
+}
+
+void FSkelotCommandBuffer::SetTransform(FSkelotInstanceHandle Handle, const FTransform& Transform)
+{
+	Transforms.Emplace(Handle, Transform);
+}
+
+void FSkelotCommandBuffer::SetVelocity(FSkelotInstanceHandle Handle, const FVector3f& Velocity)
+{
+	Velocities.Emplace(Handle, Velocity);
+}
+
+void FSkelotCommandBuffer::PlayAnimation(FSkelotInstanceHandle Handle, const FSkelotAnimPlayParams& Params)
+{
+	Animations.Add(FAnimCmd{ Handle, Params });
+}
+
+void FSkelotCommandBuffer::AttachMesh(FSkelotInstanceHandle Handle, USkeletalMesh* Mesh, bool bAttach)
+{
+	MeshAttachments.Add(FAttachMeshCmd{ Handle, Mesh, bAttach });
+}
+
+bool FSkelotCommandBuffer::IsEmpty() const
+{
+	return Num() == 0;
+}
+
+int32 FSkelotCommandBuffer::Num() const
+{
+	return Creates.Num() + Destroys.Num() + Transforms.Num() + Velocities.Num() + Animations.Num() + MeshAttachments.Num();
+}
+
+void FSkelotCommandBuffer::Reset()
+{
+	Creates.Reset();
+	CreateAnimParams.Reset();
+	Destroys.Reset();
+	Transforms.Reset();
+	Velocities.Reset();
+	Animations.Reset();
+	MeshAttachments.Reset();
+	OnInstancesCreated = nullptr;
+}
@@ -18,10 +18,16 @@ USkelotInstanceComponent::USkelotInstanceComponent()
 
 void USkelotInstanceComponent::OnUpdateTransform(EUpdateTransformFlags UpdateTransformFlags, ETeleportType Teleport /*= ETeleportType::None*/)
 {
+	if (bTransformSyncPending)
+		return;
+
 	ASkelotWorld* SKWorld = ASkelotWorld::Get(GetWorld(), false);
 	if (SKWorld && SKWorld->IsHandleValid(Handle))
 	{
-		SKWorld->SetInstanceTransform(Handle.InstanceIndex, this->GetComponentTransform());
+		if (bDeferredTransformSync)
+			SKWorld->MarkInstanceComponentDirty(this);
+		else
+			SKWorld->SetInstanceTransform(Handle.InstanceIndex, this->GetComponentTransform());
 	}
 }
 
@@ -0,0 +1,128 @@
+// Copyright 2024 Lazy Marmot Games. All Rights Reserved.
+
+#include "SkelotInstanceSnapshot.h"
+#include "SkelotPrivate.h"
+#include "Async/ParallelFor.h"
+
+FSkelotSnapshotBuffer::FReadScope::FReadScope(const FSkelotSnapshotBuffer& InOwner) : Owner(InOwner)
+{
+	while (true)
+	{
+		const int32 Front = Owner.FrontIndex.load();
+		if (Front == -1)
+			return;
+
+		Owner.NumReaders[Front].fetch_add(1);
+		//front might have been swapped before we registered, writer could be filling it now
+		if (Owner.FrontIndex.load() == Front)
+		{
+			Index = Front;
+			return;
+		}
+		Owner.NumReaders[Front].fetch_sub(1);
+	}
+}
+
+FSkelotSnapshotBuffer::FReadScope::~FReadScope()
+{
+	if (Index != -1)
+		Owner.NumReaders[Index].fetch_sub(1);
+}
+
+bool FSkelotSnapshotBuffer::Publish(const FSkelotInstancesSOA& SOA, int32 NumInstance)
+{
+	check(IsInGameThread());
+	SKELOT_SCOPE_CYCLE_COUNTER(PublishSnapshot);
+
+	const int32 NumWord = FMath::DivideAndRoundUp(NumInstance, 64);
+
+	//frames without a Publish call weren't accumulated into the pending masks
+	if (LastPublishFrame + 1 != GFrameCounter)
+		bNeedsFullTransformCopy[0] = bNeedsFullTransformCopy[1] = true;
+
+	LastPublishFrame = GFrameCounter;
+
+	//both buffers need this frame's transform changes, whenever they get written next
+	for (TArray<uint64>& PendingDirty : PendingDirtyMasks)
+	{
+		if (PendingDirty.Num() < NumWord)
+			PendingDirty.SetNumZeroed(NumWord);
+
+		for (int32 WordIndex = 0; WordIndex < NumWord; WordIndex++)
+			PendingDirty[WordIndex] |= SOA.TransformDirtyMask[WordIndex];
+	}
+
+	const int32 Back = FrontIndex.load() == 0 ? 1 : 0;
+	if (NumReaders[Back].load() != 0)
+		return false;
+
+	FSkelotInstanceSnapshot& Snapshot = Buffers[Back];
+	TArray<uint64>& PendingDirty = PendingDirtyMasks[Back];
+
+	//buffer never held these instances or missed some dirty bits, copy all of their transforms
+	const bool bFullTransformCopy = bNeedsFullTransformCopy[Back] || Snapshot.Locations.Num() < NumInstance;
+	bNeedsFullTransformCopy[Back] = false;
+	if (Snapshot.Locations.Num() < NumInstance)
+	{
+		Snapshot.Locations.SetNumUninitialized(NumInstance);
+		Snapshot.Rotations.SetNumUninitialized(NumInstance);
+		Snapshot.Velocities.SetNumUninitialized(NumInstance);
+		Snapshot.AnimStates.SetNumUninitialized(NumInstance);
+		Snapshot.Versions.SetNumUninitialized(NumInstance);
+		Snapshot.AliveMask.SetNumUninitialized(NumWord);
+	}
+
+	const EParallelForFlags ParallelFlags = NumWord * 64 < GSkelot_MinParallelBatchSize ? EParallelForFlags::ForceSingleThread : EParallelForFlags::None;
+	ParallelFor(NumWord, [&](int32 WordIndex) {
+
+		const int32 Start = WordIndex * 64;
+		const int32 End = FMath::Min(Start + 64, NumInstance);
+		uint64 AliveBits = 0;
+
+		for (int32 InstanceIndex = Start; InstanceIndex < End; InstanceIndex++)
+		{
+			const FSkelotInstancesSOA::FSlotData& Slot = SOA.Slots[InstanceIndex];
+			const FSkelotInstancesSOA::FAnimData& AnimData = SOA.AnimDatas[InstanceIndex];
+
+			AliveBits |= uint64(!Slot.bDestroyed) << (InstanceIndex - Start);
+			Snapshot.Versions[InstanceIndex] = Slot.Version;
+			Snapshot.Velocities[InstanceIndex] = SOA.Velocities[InstanceIndex];
+			Snapshot.AnimStates[InstanceIndex] = FSkelotInstanceSnapshot::FAnimState{ AnimData.CurrentAsset, AnimData.AnimationTime, AnimData.AnimationPlayRate };
+		}
+
+		Snapshot.AliveMask[WordIndex] = AliveBits;
+
+		uint64 DirtyBits = bFullTransformCopy ? MAX_uint64 : PendingDirty[WordIndex];
+		for (; DirtyBits; DirtyBits &= DirtyBits - 1)
+		{
+			const int32 InstanceIndex = Start + static_cast<int32>(FMath::CountTrailingZeros64(DirtyBits));
+			if (InstanceIndex >= End)
+				break;
+
+			Snapshot.Locations[InstanceIndex] = SOA.Locations[InstanceIndex];
+			Snapshot.Rotations[InstanceIndex] = SOA.Rotations[InstanceIndex];
+		}
+
+		PendingDirty[WordIndex] = 0;
+
+	}, ParallelFlags);
+
+	Snapshot.FrameNumber = GFrameCounter;
+	Snapshot.NumInstance = NumInstance;
+
+	FrontIndex.store(Back);
+	return true;
+}
+
+void FSkelotSnapshotBuffer::Reset()
+{
+	check(NumReaders[0].load() == 0 && NumReaders[1].load() == 0);
+
+	FrontIndex.store(-1);
+	for (int32 Index = 0; Index < 2; Index++)
+	{
+		Buffers[Index] = FSkelotInstanceSnapshot();
+		PendingDirtyMasks[Index].Empty();
+		bNeedsFullTransformCopy[Index] = true;
+	}
+}
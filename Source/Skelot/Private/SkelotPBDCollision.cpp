@@ -234,9 +234,10 @@ void FSkelotPBDCollisionSystem::SolveIteration(FSkelotInstancesSOA& SOA, int32 N
 	PerInstanceCorrectionSums.SetNumUninitialized(NumInstances);
 	FMemory::Memzero(PerInstanceCorrectionSums.GetData(), NumInstances * sizeof(float));
 
-	ParallelFor(TEXT("PBD_SolveIteration"), NumInstances, 1, [&](int32 InstanceIndex)
+	SOA.ParallelForEachAlive(NumInstances, EParallelForFlags::None, [&](int32 InstanceIndex)
 	{
-		if (SOA.Slots[InstanceIndex].bDestroyed)
+		// 重要度降频：本帧不推开该实例，它仍作为邻居参与其他实例的求解
+		if (!SOA.ShouldUpdateBySignificance(ESkelotSignificanceUser::PBD, InstanceIndex))
 		{
 			return;
 		}
@@ -307,6 +308,7 @@ void FSkelotPBDCollisionSystem::SolveIteration(FSkelotInstancesSOA& SOA, int32 N
 		{
 			// 将 FVector3f 校正量添加到 FVector3d 位置
 			SOA.Locations[i] += FVector3d(Correction);
+			SOA.MarkTransformDirty(i);
 
 			ApplyVelocityProjection(SOA, i, Correction, DeltaTime);
 		}
@@ -357,13 +359,8 @@ void FSkelotPBDCollisionSystem::SolveObstacleCollisions(FSkelotInstancesSOA& SOA
 	TArray<float> ObstacleCorrectionSums;
 	ObstacleCorrectionSums.SetNumZeroed(NumInstances);
 
-	ParallelFor(TEXT("PBD_SolveObstacles"), NumInstances, 1, [&](int32 InstanceIndex)
+	SOA.ParallelForEachAlive(NumInstances, EParallelForFlags::None, [&](int32 InstanceIndex)
 	{
-		if (SOA.Slots[InstanceIndex].bDestroyed)
-		{
-			return;
-		}
-
 		FVector InstanceLocation(SOA.Locations[InstanceIndex]);
 		float InstanceRadius = Config.CollisionRadius;
 		uint8 InstanceCollisionMask = SOA.CollisionMasks[InstanceIndex];
@@ -383,6 +380,7 @@ void FSkelotPBDCollisionSystem::SolveObstacleCollisions(FSkelotInstancesSOA& SOA
 			{
 				FVector3f Correction = FVector3f(PushDirection * PushMagnitude * Config.RelaxationFactor);
 				SOA.Locations[InstanceIndex] += FVector3d(Correction);
+				SOA.MarkTransformDirty(InstanceIndex);
 				InstanceLocation += FVector(Correction);
 				ApplyVelocityProjection(SOA, InstanceIndex, Correction, DeltaTime);
 
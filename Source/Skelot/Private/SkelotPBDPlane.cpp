@@ -15,6 +15,7 @@ ASkelotPBDPlane::ASkelotPBDPlane()
 	RVOConfig = FSkelotRVOConfig::GetRecommendedConfig();
 	AntiJitterConfig = FSkelotAntiJitterConfig::GetRecommendedConfig();
 	LODConfig = FSkelotLODConfig::GetRecommendedConfig();
+	SignificanceConfig = FSkelotSignificanceConfig::GetRecommendedConfig();
 }
 
 void ASkelotPBDPlane::BeginPlay()
@@ -49,6 +50,9 @@ void ASkelotPBDPlane::ApplyConfigToWorld()
 	// 应用 LOD 配置
 	SkelotWorld->SetLODConfig(LODConfig);
 
+	// 应用重要度配置
+	SkelotWorld->SetSignificanceConfig(SignificanceConfig);
+
 	UE_LOG(LogTemp, Log, TEXT("ASkelotPBDPlane - Applied config to SkelotWorld: PBD=%s, RVO=%s, LOD=%s, Radius=%.1f, Iterations=%d"),
 		PBDConfig.bEnablePBD ? TEXT("Enabled") : TEXT("Disabled"),
 		RVOConfig.bEnableRVO ? TEXT("Enabled") : TEXT("Disabled"),
@@ -63,6 +67,7 @@ void ASkelotPBDPlane::LoadRecommendedConfig()
 	RVOConfig = FSkelotRVOConfig::GetRecommendedConfig();
 	AntiJitterConfig = FSkelotAntiJitterConfig::GetRecommendedConfig();
 	LODConfig = FSkelotLODConfig::GetRecommendedConfig();
+	SignificanceConfig = FSkelotSignificanceConfig::GetRecommendedConfig();
 }
 
 ASkelotWorld* ASkelotPBDPlane::GetSkelotWorld() const
@@ -56,6 +56,16 @@ FAutoConsoleVariableRef CVar_ClusterCellSize(TEXT("skelot.ClusterCellSize"), GSk
 bool GSkelot_DisableTransitionGeneration = false;
 FAutoConsoleVariableRef CV_DisableTransitionGeneration(TEXT("skelot.DisableTransitionGeneration"), GSkelot_DisableTransitionGeneration, TEXT("true if no more transition should be generated. only those in cache are used."), ECVF_Default);
 
+float GSkelot_TransitionGenerationBudgetMS = 2;
+FAutoConsoleVariableRef CV_TransitionGenerationBudgetMS(TEXT("skelot.TransitionGenerationBudgetMS"), GSkelot_TransitionGenerationBudgetMS, TEXT("time budget of the background task that generates transitions, remaining ones are generated in the next frames. <= 0 generates them all at end of frame on the game thread."), ECVF_Default);
+
+int32 GSkelot_TransitionDefragMaxMoves = 16;
+FAutoConsoleVariableRef CV_TransitionDefragMaxMoves(TEXT("skelot.TransitionDefragMaxMoves"), GSkelot_TransitionDefragMaxMoves, TEXT("maximum number of transitions moved per frame by transition pool defragmentation. 0 disables it."), ECVF_Default);
+
+float GSkelot_TransitionDefragThreshold = 0.25f;
+FAutoConsoleVariableRef CV_TransitionDefragThreshold(TEXT("skelot.TransitionDefragThreshold"), GSkelot_TransitionDefragThreshold, TEXT("transition pool is defragmented while the ratio of free frames below its high water mark is above this."), ECVF_Default);
+
+
 
 bool GSkelot_DisableTransition = false;
 FAutoConsoleVariableRef CV_DisableTransition(TEXT("skelot.DisableTransition"), GSkelot_DisableTransition, TEXT("if true no animation will be played with transition."), ECVF_Default);
@@ -66,6 +76,12 @@ FAutoConsoleVariableRef CV_ForcePerInstanceLocalBounds(TEXT("skelot.ForcePerInst
 bool GSkelot_ForceDefaultMaterial = false;
 FAutoConsoleVariableRef CV_ForceDefaultMaterial(TEXT("skelot.ForceDefaultMaterial"), GSkelot_ForceDefaultMaterial, TEXT(""), ECVF_Default);
 
+int32 GSkelot_MinParallelBatchSize = 256;
+FAutoConsoleVariableRef CV_MinParallelBatchSize(TEXT("skelot.MinParallelBatchSize"), GSkelot_MinParallelBatchSize, TEXT("batch operations on fewer instances than this run single threaded."), ECVF_Default);
+
+int32 GSkelot_ClusterBoundsShrinkInterval = 16;
+FAutoConsoleVariableRef CV_ClusterBoundsShrinkInterval(TEXT("skelot.ClusterBoundsShrinkInterval"), GSkelot_ClusterBoundsShrinkInterval, TEXT("number of frames between rebuilds of cluster bounds that may shrink."), ECVF_Default);
+
 
 #if !(UE_BUILD_SHIPPING || UE_BUILD_TEST)
 
@@ -34,6 +34,9 @@ DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("AvgInstanceCountPerClusterComp"), STAT_S
 extern float	GSkelot_LocalBoundUpdateInterval;
 extern bool		GSkelot_CallAnimNotifies;
 extern bool		GSkelot_DisableTransitionGeneration;
+extern float	GSkelot_TransitionGenerationBudgetMS;
+extern int32	GSkelot_TransitionDefragMaxMoves;
+extern float	GSkelot_TransitionDefragThreshold;
 extern bool		GSkelot_DisableTransition;
 extern float	GSkelot_LocalBoundUpdateInterval;
 extern bool		GSkelot_CallAnimNotifies;
@@ -51,6 +54,8 @@ extern bool		GSkelot_UseStaticDrawList;
 extern float	GSkelot_ClusterCellSize;
 extern bool		GSkelot_ForcePerInstanceLocalBounds;
 extern bool		GSkelot_ForceDefaultMaterial;
+extern int32	GSkelot_MinParallelBatchSize;
+extern int32	GSkelot_ClusterBoundsShrinkInterval;
 
 
 //CVars available in debug but excluded in shipping
@@ -17,52 +17,6 @@ template <typename TType, typename TSize> void SkelotElementCopy(TType* Dst, con
 		Dst[i] = Src[i];
 }
 
-inline bool SkelotTerminatedArrayAddUnique(uint8* Array /*must be 0xFF terminated*/, uint8 MaxLen , uint8 NewItem)
-{
-	check(NewItem != 0xFF);
-	auto End = Array + MaxLen;
-
-	for (auto Iter = Array; Iter != End; Iter++)
-	{
-		if (Iter[0] == NewItem)	//already exist ?
-			return true;
-
-		if (Iter[0] == 0xFF)
-		{
-			Iter[0] = NewItem;
-			Iter[1] = 0xFF;
-			return true;
-		}
-	}
-
-	return false;
-}
-
-inline bool SkelotTerminatedArrayRemoveShift(uint8* Array /*must be 0xFF terminated*/, uint8 MaxLen, uint8 ItemToRemove)
-{
-	check(ItemToRemove != 0xFF);
-	auto End = Array + MaxLen;
-
-	for (auto Iter = Array; Iter != End; Iter++)
-	{
-		if (Iter[0] == ItemToRemove) //found it ?
-		{
-			do
-			{
-				Iter[0] = Iter[1];
-				Iter++;
-
-			} while (Iter[0] != 0xFF);
-
-			return true;
-		}
-	}
-
-	return false;
-}
-
-
-
 template<typename T> void SkelotRemoveDuplicates(T* Elements, uint32 Len)
 {
 	// use nested for loop to find the duplicate elements in array  
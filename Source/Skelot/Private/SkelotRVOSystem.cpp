@@ -109,14 +109,15 @@ void FSkelotRVOSystem::ComputeAvoidance(FSkelotInstancesSOA& SOA, int32 NumInsta
 	OutputVelocities.SetNumUninitialized(NumInstances);
 	FMemory::Memcpy(OutputVelocities.GetData(), InputVelocities.GetData(), NumInstances * sizeof(FVector3f));
 
-	ParallelFor(TEXT("RVO_ComputeAvoidance"), NumInstances, 1, [&](int32 InstanceIndex)
+	SOA.ParallelForEachAlive(NumInstances, EParallelForFlags::None, [&](int32 InstanceIndex)
 	{
-		if (SOA.Slots[InstanceIndex].bDestroyed)
+		if (Config.FrameStride > 1 && (InstanceIndex % Config.FrameStride) != FrameCounter)
 		{
 			return;
 		}
 
-		if (Config.FrameStride > 1 && (InstanceIndex % Config.FrameStride) != FrameCounter)
+		// 重要度降频：未更新的实例沿用上次避障后的速度
+		if (!SOA.ShouldUpdateBySignificance(ESkelotSignificanceUser::RVO, InstanceIndex))
 		{
 			return;
 		}
@@ -91,9 +91,9 @@ void FSkelotAnimationBuffer::AllocateBuffer()
 		delete Transforms;
 
 	if (bHighPrecision)
-		Transforms = new TStaticMeshVertexData<FMatrix3x4>();
+		Transforms = new TStaticMeshVertexData<FMatrix3x4>(bKeepCPUData);
 	else
-		Transforms = new TStaticMeshVertexData<FMatrix3x4Half>();
+		Transforms = new TStaticMeshVertexData<FMatrix3x4Half>(bKeepCPUData);
 }
 
 void FSkelotAnimationBuffer::InitBuffer(const TArrayView<FTransform> InTransforms, bool InHightPrecision)
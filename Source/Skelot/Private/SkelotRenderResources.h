@@ -174,6 +174,8 @@ public:
 	FShaderResourceViewRHIRef ShaderResourceViewRHI;
 	FUnorderedAccessViewRHIRef UAV;
 	bool bHighPrecision = false;
+	//true if Transforms should stay in memory after the RHI buffer is created
+	bool bKeepCPUData = false;
 	
 	~FSkelotAnimationBuffer();
 	void InitRHI(FRHICommandListBase& RHICmdList) override;
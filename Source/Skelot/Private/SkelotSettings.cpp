@@ -8,4 +8,5 @@ USkelotDeveloperSettings::USkelotDeveloperSettings(const FObjectInitializer& Ini
 {
 	CategoryName = TEXT("Plugins");
 	MaxTransitionGenerationPerFrame = 200;
+	bSparseRootMotions = false;
 }
\ No newline at end of file
@@ -46,20 +46,60 @@ ASkelotWorld* USkelotWorldSubsystem::Internal_GetSingleton(const UWorld* World,
 	{
 		check(!SkelotWSS->PrimaryInstance->IsTemplate());
 		check(SkelotWSS->PrimaryInstance->SOA.Slots.Num() > 0);
+
+		if (SkelotWSS->Shards.Num() == 0)
+			SkelotWSS->Shards.Add(SkelotWSS->PrimaryInstance);
+		else
+			SkelotWSS->Shards[0] = SkelotWSS->PrimaryInstance;
 	}
 
 	return SkelotWSS->PrimaryInstance;
 }
 
+ASkelotWorld* USkelotWorldSubsystem::GetShard(const UObject* WorldContextObject, int32 ShardIndex, bool bCreateIfNotFound)
+{
+	if (ShardIndex == 0)
+		return Internal_GetSingleton(WorldContextObject, bCreateIfNotFound);
+
+	if (ShardIndex < 0 || ShardIndex >= (int32)FSkelotInstanceHandle::MaxShards)
+		return nullptr;
+
+	//primary must exist before any other shard
+	ASkelotWorld* Primary = Internal_GetSingleton(WorldContextObject, bCreateIfNotFound);
+	if (!Primary)
+		return nullptr;
+
+	USkelotWorldSubsystem* SkelotWSS = Primary->GetWorld()->GetSubsystem<USkelotWorldSubsystem>();
+	if (SkelotWSS->Shards.IsValidIndex(ShardIndex) && IsValid(SkelotWSS->Shards[ShardIndex]))
+		return SkelotWSS->Shards[ShardIndex];
+
+	if (!bCreateIfNotFound)
+		return nullptr;
+
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.ObjectFlags |= RF_Transient;
+
+	ASkelotWorld* Shard = Primary->GetWorld()->SpawnActor<ASkelotWorld>(Primary->GetClass(), SpawnParams);
+	if (!Shard)
+		return nullptr;
+
+	Shard->SetShardIndex(ShardIndex);
+	if (SkelotWSS->Shards.Num() <= ShardIndex)
+		SkelotWSS->Shards.SetNumZeroed(ShardIndex + 1);
+
+	SkelotWSS->Shards[ShardIndex] = Shard;
+	return Shard;
+}
+
 ASkelotWorld* USkelotWorldSubsystem::GetSingleton(const UObject* WorldContextObject, FSkelotInstanceHandle Handle)
 {
-	ASkelotWorld* SK = GetSingleton(WorldContextObject);
+	ASkelotWorld* SK = ASkelotWorld::Get(WorldContextObject, Handle);
 	return SK && SK->IsHandleValid(Handle) ? SK : nullptr;
 }
 
 ASkelotWorld* USkelotWorldSubsystem::GetSingleton(const UObject* WorldContextObject, FSkelotInstanceHandle Handle0, FSkelotInstanceHandle Handle1)
 {
-	ASkelotWorld* SK = GetSingleton(WorldContextObject);
+	ASkelotWorld* SK = ASkelotWorld::Get(WorldContextObject, Handle0);
 	return SK && SK->IsHandleValid(Handle0) && SK->IsHandleValid(Handle1) ? SK : nullptr;
 }
 
@@ -68,6 +108,74 @@ ASkelotWorld* USkelotWorldSubsystem::GetSingleton(const UObject* WorldContextObj
 	return Internal_GetSingleton(WorldContextObject, true);
 }
 
+/*
+batch nodes may get handles of several shards. calls Proc(ASkelotWorld* Shard, const TArray<FSkelotInstanceHandle>& ShardHandles, const TArray<int32>& ArgIndices) for each shard,
+ArgIndices maps ShardHandles back to the input. if all handles are in one shard (the common case) the input array is passed as is and ArgIndices is empty.
+*/
+template<typename TLambda> static void SkelotForEachHandleShard(const UObject* WorldContextObject, const TArray<FSkelotInstanceHandle>& Handles, TLambda Proc)
+{
+	static_assert(FSkelotInstanceHandle::MaxShards <= 32);
+	uint32 ShardMask = 0;
+	for (const FSkelotInstanceHandle& H : Handles)
+	{
+		if (H.IsValid())
+			ShardMask |= 1u << H.GetShardIndex();
+	}
+
+	if (FMath::CountBits(ShardMask) <= 1)
+	{
+		const int32 ShardIndex = ShardMask ? static_cast<int32>(FMath::CountTrailingZeros(ShardMask)) : 0;
+		if (ASkelotWorld* Shard = USkelotWorldSubsystem::GetShard(WorldContextObject, ShardIndex, ShardIndex == 0))
+			Proc(Shard, Handles, TArray<int32>());
+
+		return;
+	}
+
+	TArray<FSkelotInstanceHandle> ShardHandles;
+	TArray<int32> ArgIndices;
+	for (; ShardMask; ShardMask &= ShardMask - 1)
+	{
+		const int32 ShardIndex = static_cast<int32>(FMath::CountTrailingZeros(ShardMask));
+		ASkelotWorld* Shard = USkelotWorldSubsystem::GetShard(WorldContextObject, ShardIndex, false);
+		if (!Shard)
+		{
+			UE_LOG(LogSkelot, Warning, TEXT("batch handles refer to shard %d which doesn't exist, they are skipped."), ShardIndex);
+			continue;
+		}
+
+		ShardHandles.Reset();
+		ArgIndices.Reset();
+		for (int32 ArgIndex = 0; ArgIndex < Handles.Num(); ArgIndex++)
+		{
+			if (Handles[ArgIndex].IsValid() && Handles[ArgIndex].GetShardIndex() == static_cast<uint32>(ShardIndex))
+			{
+				ShardHandles.Add(Handles[ArgIndex]);
+				ArgIndices.Add(ArgIndex);
+			}
+		}
+
+		Proc(Shard, ShardHandles, ArgIndices);
+	}
+}
+
+//values of the handles selected by ArgIndices (NumPerHandle values each) gathered in Scratch. input is returned as is if all handles are selected or it holds a single set of values for all handles
+template<typename T> static TConstArrayView<T> SkelotGatherBatchValues(const TArray<T>& Values, const TArray<int32>& ArgIndices, TArray<T>& Scratch, int32 NumPerHandle = 1)
+{
+	if (ArgIndices.Num() == 0 || Values.Num() == NumPerHandle)
+		return Values;
+
+	Scratch.Reset(ArgIndices.Num() * NumPerHandle);
+	for (int32 ArgIndex : ArgIndices)
+	{
+		for (int32 ValueIndex = ArgIndex * NumPerHandle; ValueIndex < (ArgIndex + 1) * NumPerHandle; ValueIndex++)
+		{
+			if (Values.IsValidIndex(ValueIndex)) //size mismatch is reported by the shard
+				Scratch.Add(Values[ValueIndex]);
+		}
+	}
+	return Scratch;
+}
+
 
 bool USkelotWorldSubsystem::Skelot_AttachMesh(const UObject* WorldContextObject, FSkelotInstanceHandle Handle, const USkeletalMesh* Mesh, FName OrName, int32 OrIndex /*= -1*/, bool bAttach /*= true*/)
 {
@@ -155,7 +263,7 @@ float USkelotWorldSubsystem::Skelot_GetCustomDataFloat(const UObject* WorldConte
 {
 	if (ASkelotWorld* Singleton = GetSingleton(WorldContextObject, Handle))
 	{
-		const float* Floats = Singleton->GetInstanceCustomDataFloats(Handle.InstanceIndex);
+		const float* Floats = Singleton->FindInstanceCustomDataFloats(Handle.InstanceIndex);
 		if (Floats)
 		{
 			if(FloatIndex < Singleton->SOA.MaxNumCustomDataFloat)
@@ -420,6 +528,100 @@ void USkelotWorldSubsystem::SetRootMotionParams(const UObject* WorldContextObjec
 	}
 }
 
+void USkelotWorldSubsystem::Skelot_SetSignificancePriority(const UObject* WorldContextObject, FSkelotInstanceHandle Handle, uint8 Priority)
+{
+	if (ASkelotWorld* Singleton = GetSingleton(WorldContextObject, Handle))
+	{
+		Singleton->SetInstanceSignificancePriority(Handle.InstanceIndex, Priority);
+	}
+}
+
+float USkelotWorldSubsystem::Skelot_GetSignificance(const UObject* WorldContextObject, FSkelotInstanceHandle Handle)
+{
+	if (ASkelotWorld* Singleton = GetSingleton(WorldContextObject, Handle))
+	{
+		return Singleton->GetInstanceSignificance(Handle.InstanceIndex);
+	}
+	return 0;
+}
+
+void USkelotWorldSubsystem::Skelot_SetInstanceGroup(const UObject* WorldContextObject, FSkelotInstanceHandle Handle, int32 GroupId)
+{
+	if (ASkelotWorld* Singleton = GetSingleton(WorldContextObject, Handle))
+	{
+		Singleton->SetInstanceGroup(Handle.InstanceIndex, GroupId);
+	}
+}
+
+int32 USkelotWorldSubsystem::Skelot_GetInstanceGroup(const UObject* WorldContextObject, FSkelotInstanceHandle Handle)
+{
+	if (ASkelotWorld* Singleton = GetSingleton(WorldContextObject, Handle))
+	{
+		return Singleton->GetInstanceGroup(Handle.InstanceIndex);
+	}
+	return -1;
+}
+
+void USkelotWorldSubsystem::Skelot_SetInstanceTags(const UObject* WorldContextObject, FSkelotInstanceHandle Handle, int64 Tags)
+{
+	if (ASkelotWorld* Singleton = GetSingleton(WorldContextObject, Handle))
+	{
+		Singleton->SetInstanceTags(Handle.InstanceIndex, static_cast<uint64>(Tags));
+	}
+}
+
+int64 USkelotWorldSubsystem::Skelot_GetInstanceTags(const UObject* WorldContextObject, FSkelotInstanceHandle Handle)
+{
+	if (ASkelotWorld* Singleton = GetSingleton(WorldContextObject, Handle))
+	{
+		return static_cast<int64>(Singleton->GetInstanceTags(Handle.InstanceIndex));
+	}
+	return 0;
+}
+
+void USkelotWorldSubsystem::Skelot_QueryInstancesByFilter(const UObject* WorldContextObject, const FSkelotInstanceFilter& Filter, TArray<FSkelotInstanceHandle>& OutHandles)
+{
+	OutHandles.Reset();
+	if (ASkelotWorld* Singleton = GetSingleton(WorldContextObject))
+	{
+		Singleton->QueryInstancesByFilter(Filter, OutHandles);
+	}
+}
+
+int32 USkelotWorldSubsystem::Skelot_PlayAnimationByFilter(const UObject* WorldContextObject, const FSkelotInstanceFilter& Filter, const FSkelotAnimPlayParams& Params)
+{
+	if (ASkelotWorld* Singleton = GetSingleton(WorldContextObject))
+	{
+		return Singleton->PlayAnimationByFilter(Filter, Params);
+	}
+	return 0;
+}
+
+void USkelotWorldSubsystem::Skelot_SetVelocityByFilter(const UObject* WorldContextObject, const FSkelotInstanceFilter& Filter, const FVector3f& Velocity)
+{
+	if (ASkelotWorld* Singleton = GetSingleton(WorldContextObject))
+	{
+		Singleton->SetVelocityByFilter(Filter, Velocity);
+	}
+}
+
+void USkelotWorldSubsystem::Skelot_SetCustomDataFloatsByFilter(const UObject* WorldContextObject, const FSkelotInstanceFilter& Filter, int32 Offset, const TArray<float>& Values)
+{
+	if (ASkelotWorld* Singleton = GetSingleton(WorldContextObject))
+	{
+		Singleton->SetCustomDataFloatByFilter(Filter, Values.GetData(), FMath::Max(0, Offset), Values.Num());
+	}
+}
+
+int32 USkelotWorldSubsystem::Skelot_DestroyInstancesByFilter(const UObject* WorldContextObject, const FSkelotInstanceFilter& Filter)
+{
+	if (ASkelotWorld* Singleton = GetSingleton(WorldContextObject))
+	{
+		return Singleton->DestroyInstancesByFilter(Filter);
+	}
+	return 0;
+}
+
 void USkelotWorldSubsystem::Skelot_SetTimer(const UObject* WorldContextObject, FSkelotInstanceHandle Handle, float Interval, bool bLoop, bool bGameTime, FSkelotGeneralDynamicDelegate Delegate, FName PayloadTag /*= FName()*/, UObject* PayloadObject /*= nullptr*/)
 {
 	if (ASkelotWorld* Singleton = GetSingleton(WorldContextObject, Handle))
@@ -489,11 +691,59 @@ void USkelotWorldSubsystem::Skelot_DestroyInstance(const UObject* WorldContextOb
 
 void USkelotWorldSubsystem::Skelot_DestroyInstances(const UObject* WorldContextObject, const TArray<FSkelotInstanceHandle>& Handles)
 {
-	if (ASkelotWorld* Singleton = GetSingleton(WorldContextObject))
-	{
-		for (FSkelotInstanceHandle H : Handles)
-			Singleton->DestroyInstance(H);
-	}
+	SkelotForEachHandleShard(WorldContextObject, Handles, [&](ASkelotWorld* Shard, const TArray<FSkelotInstanceHandle>& ShardHandles, const TArray<int32>& ArgIndices) {
+		Shard->DestroyInstances(ShardHandles);
+	});
+}
+
+void USkelotWorldSubsystem::Skelot_SetTransforms(const UObject* WorldContextObject, const TArray<FSkelotInstanceHandle>& Handles, const TArray<FTransform>& Transforms)
+{
+	TArray<FTransform> Scratch;
+	SkelotForEachHandleShard(WorldContextObject, Handles, [&](ASkelotWorld* Shard, const TArray<FSkelotInstanceHandle>& ShardHandles, const TArray<int32>& ArgIndices) {
+		Shard->SetInstanceTransforms(ShardHandles, SkelotGatherBatchValues(Transforms, ArgIndices, Scratch));
+	});
+}
+
+void USkelotWorldSubsystem::Skelot_GetLocations(const UObject* WorldContextObject, const TArray<FSkelotInstanceHandle>& Handles, TArray<FVector>& OutLocations)
+{
+	OutLocations.Init(FVector::ZeroVector, Handles.Num());
+
+	TArray<FVector> ShardLocations;
+	SkelotForEachHandleShard(WorldContextObject, Handles, [&](ASkelotWorld* Shard, const TArray<FSkelotInstanceHandle>& ShardHandles, const TArray<int32>& ArgIndices) {
+		if (ArgIndices.Num() == 0)
+		{
+			Shard->GetInstanceLocations(ShardHandles, OutLocations);
+			return;
+		}
+
+		Shard->GetInstanceLocations(ShardHandles, ShardLocations);
+		for (int32 Index = 0; Index < ArgIndices.Num(); Index++)
+			OutLocations[ArgIndices[Index]] = ShardLocations[Index];
+	});
+}
+
+void USkelotWorldSubsystem::Skelot_PlayAnimations(const UObject* WorldContextObject, const TArray<FSkelotInstanceHandle>& Handles, const TArray<FSkelotAnimPlayParams>& Params)
+{
+	TArray<FSkelotAnimPlayParams> Scratch;
+	SkelotForEachHandleShard(WorldContextObject, Handles, [&](ASkelotWorld* Shard, const TArray<FSkelotInstanceHandle>& ShardHandles, const TArray<int32>& ArgIndices) {
+		Shard->InstancesPlayAnimation(ShardHandles, SkelotGatherBatchValues(Params, ArgIndices, Scratch));
+	});
+}
+
+void USkelotWorldSubsystem::Skelot_SetCustomDataFloats(const UObject* WorldContextObject, const TArray<FSkelotInstanceHandle>& Handles, int32 Offset, int32 NumFloatPerInstance, const TArray<float>& Values)
+{
+	TArray<float> Scratch;
+	SkelotForEachHandleShard(WorldContextObject, Handles, [&](ASkelotWorld* Shard, const TArray<FSkelotInstanceHandle>& ShardHandles, const TArray<int32>& ArgIndices) {
+		Shard->SetInstancesCustomDataFloat(ShardHandles, SkelotGatherBatchValues(Values, ArgIndices, Scratch, FMath::Max(1, NumFloatPerInstance)), FMath::Max(0, Offset), NumFloatPerInstance);
+	});
+}
+
+void USkelotWorldSubsystem::Skelot_AttachMeshToInstances(const UObject* WorldContextObject, const TArray<FSkelotInstanceHandle>& Handles, const TArray<USkeletalMesh*>& Meshes, bool bAttach /*= true*/)
+{
+	TArray<USkeletalMesh*> Scratch;
+	SkelotForEachHandleShard(WorldContextObject, Handles, [&](ASkelotWorld* Shard, const TArray<FSkelotInstanceHandle>& ShardHandles, const TArray<int32>& ArgIndices) {
+		Shard->InstancesAttachMesh(ShardHandles, SkelotGatherBatchValues(Meshes, ArgIndices, Scratch), bAttach);
+	});
 }
 
 FSkelotInstanceHandle USkelotWorldSubsystem::Skelot_CreateInstance(const UObject* WorldContextObject, const FTransform& Transform, USkelotRenderParams* Params, UObject* UserObject)
@@ -521,12 +771,7 @@ void USkelotWorldSubsystem::Skelot_CreateInstances(const UObject* WorldContextOb
 			return;
 		}
 
-		OutHandles.Reserve(Transforms.Num());
-		for (const FTransform& Transform : Transforms)
-		{
-			FSkelotInstanceHandle H = Singleton->CreateInstance(Transform, RenderParams);
-			OutHandles.Add(H);
-		}
+		Singleton->CreateInstances(Transforms, RenderParams, OutHandles);
 	}
 }
 
@@ -711,9 +956,9 @@ USkeletalMeshComponent* USkelotFunctionLib::ConstructSkeletalMeshComponents(cons
 	USkeletalMeshComponent* RootComp = nullptr;
 	Outer = Outer ? Outer : SKWorld;
 
-	for (const uint8* SMIIter = SKWorld->GetInstanceSubmeshIndices(Handle.InstanceIndex); *SMIIter != 0xFF; SMIIter++)
+	SKWorld->GetInstanceSubmeshMask(Handle.InstanceIndex).ForEach([&](uint8 SubMeshIdx)
 	{
-		const FSkelotMeshRenderDesc& MRD = RenderDesc.Meshes[*SMIIter];
+		const FSkelotMeshRenderDesc& MRD = RenderDesc.Meshes[SubMeshIdx];
 		USkeletalMeshComponent* MeshComp = NewObject<USkeletalMeshComponent>(Outer);
 		MeshComp->SetSkeletalMesh(MRD.Mesh);
 		MeshComp->OverrideMaterials = MRD.OverrideMaterials;
@@ -729,16 +974,15 @@ USkeletalMeshComponent* USkelotFunctionLib::ConstructSkeletalMeshComponents(cons
 			MeshComp->SetLeaderPoseComponent(RootComp);
 		}
 
-		if (bSetCustomPrimitiveDataFloat)
+		const float* CustomDataFloats = bSetCustomPrimitiveDataFloat ? SKWorld->FindInstanceCustomDataFloats(Handle.InstanceIndex) : nullptr;
+		if (CustomDataFloats)
 		{
 			for (int32 FloatIndex = 0; FloatIndex < RenderDesc.NumCustomDataFloat; FloatIndex++)
-				MeshComp->SetCustomPrimitiveDataFloat(FloatIndex, SKWorld->GetInstanceCustomDataFloats(Handle.InstanceIndex)[FloatIndex]);
+				MeshComp->SetCustomPrimitiveDataFloat(FloatIndex, CustomDataFloats[FloatIndex]);
 		}
 
 		MeshComp->RegisterComponent();
-
-
-	}
+	});
 
 	const FSkelotInstancesSOA::FAnimData& AD = SKWorld->SOA.AnimDatas[Handle.InstanceIndex];
 	if (RootComp && AD.IsSequenceValid())
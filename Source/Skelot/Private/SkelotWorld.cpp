@@ -31,11 +31,13 @@
 #include "Animation/AnimComposite.h"
 #include "Animation/AnimSequence.h"
 #include "SkelotAnimNotify.h"
+#include "SkelotInstanceComponent.h"
 #include "SkelotSettings.h"
 #include "Materials/Material.h"
 #include "MaterialDomain.h"
 #include "Skelot.h"
 #include "GameFramework/PlayerController.h"
+#include "Camera/PlayerCameraManager.h"
 #include "InstanceDataSceneProxy.h"
 #include "SkelotRenderResources.h"
 
@@ -138,6 +140,7 @@ public:
 			Id = RenderDescs.AddByHash(Hash, StackDesc, nullptr);
 			FSkelotInstanceRenderDescFinal& NewDesc = RenderDescs.Get(Id);
 			NewDesc.CacheMeshDefIndices();
+			NewDesc.BoundRadius = CalcDescBoundRadius(NewDesc);
 
 
 			check(NewDesc.NumCustomDataFloat < 64);
@@ -152,30 +155,14 @@ public:
 	{
 		if (NewNumCustomDataFloat > SOA.MaxNumCustomDataFloat)
 		{
-			int32 OldNumCustomDataFloat = SOA.MaxNumCustomDataFloat;
 			SOA.MaxNumCustomDataFloat = NewNumCustomDataFloat;
-			ResizeScatteredArray(SOA.PerInstanceCustomData, SOA.Slots.Num(), OldNumCustomDataFloat, NewNumCustomDataFloat);
-		}
-	}
-
-	template<typename T> void ResizeScatteredArray(TArray<T>& Array, int32 Num, int32 OldNumDataPerInstance, int32 NewNumDataPerInstance)
-	{
-		check(OldNumDataPerInstance < NewNumDataPerInstance);
-		auto OldData = MoveTemp(Array);
-		Array.SetNumZeroed(Num * NewNumDataPerInstance);
-
-		for (int32 Index = 0; Index < Num; Index++)
-		{
-			for (int32 DataIndex = 0; DataIndex < OldNumDataPerInstance; DataIndex++)
-			{
-				Array[Index * NewNumDataPerInstance + DataIndex] = MoveTemp(OldData[Index * OldNumDataPerInstance + DataIndex]);
-			}
+			SOA.PerInstanceCustomData.SetStride(NewNumCustomDataFloat);
 		}
 	}
 	//
-	void IncreaseSOAs()
+	void IncreaseSOAs(int32 MinCapacity = 0)
 	{
-		const uint32 NewSize = FMath::Max(256, SOA.Slots.Num() << 1);
+		const uint32 NewSize = FMath::RoundUpToPowerOfTwo(FMath::Max3(256, SOA.Slots.Num() << 1, MinCapacity));
 		const uint32 GrowSize = NewSize - SOA.Slots.Num();
 		InstanceIndexMask = NewSize - 1;
 
@@ -186,11 +173,11 @@ public:
 			uint32 Version;
 			do
 			{
-				Version = Rnd.GetUnsignedInt();
+				Version = Rnd.GetUnsignedInt() & FSkelotInstanceHandle::SerialMask;
 			} while (Version == 0);
 
 			SOA.Slots[BaseIdx + i].bDestroyed = true;
-			SOA.Slots[BaseIdx + i].Version = Version;
+			SOA.Slots[BaseIdx + i].Version = Version | (ShardIndex << FSkelotInstanceHandle::ShardShift);
 		}
 
 		SOA.Locations.AddZeroed(GrowSize);
@@ -209,21 +196,107 @@ public:
 		SOA.CollisionMasks.AddZeroed(GrowSize);
 
 		SOA.ClusterData.AddDefaulted(GrowSize);
-		SOA.SubmeshIndices.AddZeroed(GrowSize * (MaxSubmeshPerInstance + 1));
+		SOA.SubmeshMasks.AddZeroed(GrowSize);
 		SOA.UserData.AddZeroed(GrowSize);
 		SOA.AnimDatas.AddDefaulted(GrowSize);
 		SOA.CurAnimFrames.AddZeroed(GrowSize);
 		SOA.PreAnimFrames.AddZeroed(GrowSize);
 
-		if (SOA.MaxNumCustomDataFloat > 0)
-			SOA.PerInstanceCustomData.AddZeroed(GrowSize * SOA.MaxNumCustomDataFloat);
-
-		SOA.MiscData.AddDefaulted(GrowSize);
+		SOA.PerInstanceCustomData.AddInstances(GrowSize);
+		SOA.MiscData.AddInstances(GrowSize);
 
 		if(SOA.UserObjects.Num() != 0)
 			SOA.UserObjects.AddZeroed(GrowSize);
 
-		SOA.RootMotions.AddZeroed(GrowSize);
+		SOA.RootMotions.AddInstances(GrowSize);
+
+		SOA.Tags.AddZeroed(GrowSize);
+		SOA.RandomStates.AddZeroed(GrowSize);
+		SOA.Groups.AddDefaulted(GrowSize);
+
+		SOA.AliveMask.AddZeroed(GrowSize / 64);
+		SOA.LODLevels.AddZeroed(GrowSize);
+		SOA.Significances.AddZeroed(GrowSize);
+		SOA.SignificancePriorities.AddZeroed(GrowSize);
+		SOA.SignificanceTiers.AddZeroed(GrowSize);
+		SOA.SignificanceAnimDeltas.AddZeroed(GrowSize);
+		//instances created before the next significance pass update every frame
+		for (TArray<uint64>& Mask : SOA.SignificanceUpdateMasks)
+		{
+			if (Mask.Num() != 0)
+			{
+				const int32 FirstNewWord = Mask.AddUninitialized(GrowSize / 64);
+				FMemory::Memset(Mask.GetData() + FirstNewWord, 0xFF, (GrowSize / 64) * sizeof(uint64));
+			}
+		}
+
+		//sizes are power of two and at least 256 so always a multiple of 64
+		SOA.TransformDirtyMask.AddZeroed(GrowSize / 64);
+	}
+	//initialize the SOA columns of a freshly allocated slot. touches only data of InstanceIdx so its safe to be called in parallel for different instances.
+	void InitializeInstance(int32 InstanceIdx, const FTransform& Transform, FSetElementId DescId, const FSkelotInstanceRenderDescFinal& CurDesc)
+	{
+		uint32 OldVersion = SOA.Slots[InstanceIdx].Version;
+		//reset to default but keep version
+		SOA.Slots[InstanceIdx] = FSkelotInstancesSOA::FSlotData();
+		SOA.Slots[InstanceIdx].Version = OldVersion;
+		SOA.SetAliveBit(InstanceIdx, true);
+
+		SOA.ClusterData[InstanceIdx].ClusterIdx = -1;
+		SOA.ClusterData[InstanceIdx].DescIdx = DescId.AsInteger();
+		SOA.ClusterData[InstanceIdx].RenderIdx = -1;
+
+		//lets attach default submeshes 
+		FSkelotSubmeshMask& SubmeshMask = GetInstanceSubmeshMask(InstanceIdx);
+		SubmeshMask.Reset();
+		uint32 NumAttached = 0;
+		for (int32 MeshIdx = 0; MeshIdx < CurDesc.Meshes.Num() && NumAttached < this->MaxSubmeshPerInstance; MeshIdx++)
+		{
+			if (CurDesc.Meshes[MeshIdx].bAttachByDefault)
+			{
+				SubmeshMask.Set(MeshIdx);
+				NumAttached++;
+			}
+		}
+
+		SetInstanceTransform(InstanceIdx, Transform);
+		SOA.PrevLocations[InstanceIdx] = SOA.Locations[InstanceIdx];
+		SOA.PrevRotations[InstanceIdx] = SOA.Rotations[InstanceIdx];
+		SOA.PrevScales[InstanceIdx]	   = SOA.Scales[InstanceIdx];
+
+		//initialize velocity to zero
+		SOA.Velocities[InstanceIdx] = FVector3f::ZeroVector;
+
+		//initialize collision channel and mask to defaults
+		//default: Channel0 (value 0), mask 0xFF (collide with all channels)
+		SOA.CollisionChannels[InstanceIdx] = SkelotCollision::DefaultCollisionChannel;
+		SOA.CollisionMasks[InstanceIdx] = SkelotCollision::DefaultCollisionMask;
+
+		// 重置 RVO 代理数据，防止复用索引时继承已销毁实例的残留状态
+		RVOSystem.ResetAgentDataForInstance(InstanceIdx);
+
+		SOA.CurAnimFrames[InstanceIdx] = 0;
+		SOA.PreAnimFrames[InstanceIdx] = 0;
+		new (&SOA.AnimDatas[InstanceIdx])  FSkelotInstancesSOA::FAnimData();
+		SOA.MiscData.ResetInstance(InstanceIdx);
+
+		SOA.UserData[InstanceIdx].Pointer = nullptr;
+
+		//group membership was removed when the slot got destroyed
+		SOA.Tags[InstanceIdx] = 0;
+		//seeded by slot and version so reused slots don't repeat the sequence
+		SOA.RandomStates[InstanceIdx] = HashCombineFast(GetTypeHash(InstanceIdx), GetTypeHash(OldVersion)) | 1;
+		SOA.Groups[InstanceIdx] = FSkelotInstancesSOA::FGroupData();
+
+		SOA.LODLevels[InstanceIdx] = 0;
+		SOA.Significances[InstanceIdx] = 0;
+		SOA.SignificancePriorities[InstanceIdx] = 0;
+		SOA.SignificanceTiers[InstanceIdx] = 0;
+		SOA.SignificanceAnimDeltas[InstanceIdx] = 0;
+
+		//fill custom data with zero. sparse columns don't allocate here so this stays safe for parallel creation
+		SOA.PerInstanceCustomData.ResetInstance(InstanceIdx);
+		SOA.RootMotions.ResetInstance(InstanceIdx);
 	}
 	//
 	void ReattachToDesc(int32 InstanceIdx, const FSkelotInstanceRenderDesc& NewDescOnStack)
@@ -239,20 +312,13 @@ public:
 		{
 			//lets remove invalid sub mesh indices ----------
 			{
-				uint8* SMIIter = GetInstanceSubmeshIndices(InstanceIdx);
-				uint8* SMIIterWrite = SMIIter;
-
+				FSkelotSubmeshMask& SubmeshMask = GetInstanceSubmeshMask(InstanceIdx);
 				const FSkelotInstanceRenderDescFinal& NewRD = RenderDescs.Get(NewDescId);
-				for (; *SMIIter != 0xFF; SMIIter++)
-				{
-					if (NewRD.Meshes.IsValidIndex(*SMIIter))
-					{
-						*SMIIterWrite = *SMIIter;
-						SMIIterWrite++;
-					}
-				}
-				
-				*SMIIterWrite = 0xff;
+				const FSkelotSubmeshMask OldMask = SubmeshMask;
+				OldMask.ForEach([&](uint8 SubMeshIdx) {
+					if (!NewRD.Meshes.IsValidIndex(SubMeshIdx))
+						SubmeshMask.Clear(SubMeshIdx);
+				});
 			}
 
 			//if attached to any cluster remove it right now and let end of frame assign cluster again
@@ -272,7 +338,8 @@ public:
 				CD.DescIdx = NewDescId.AsInteger();
 			}
 
-			
+			//new desc may not match the sign of its determinant, let UpdateDeterminant check it
+			SOA.MarkTransformDirty(InstanceIdx);
 		}
 	}
 	//
@@ -285,15 +352,306 @@ public:
 		if (DeltaSeconds <= 0)
 			return;
 
+		if (SignificanceConfig.bEnableSignificance)
+		{
+			for (int32 InstanceIndex = 0; InstanceIndex < HandleAllocator.GetMaxSize(); InstanceIndex++)
+			{
+				//skipped frames are caught up in one step. tiers change every frame so the actual elapsed time is accumulated
+				float& PendingDelta = SOA.SignificanceAnimDeltas[InstanceIndex];
+				PendingDelta += DeltaSeconds;
+				if (!SOA.ShouldUpdateBySignificance(ESkelotSignificanceUser::Animation, InstanceIndex))
+					continue;
+
+				UpdateAnimation(InstanceIndex, PendingDelta);
+				PendingDelta = 0;
+			}
+			return;
+		}
+
+		if (LODConfig.bEnableLODUpdateFrequency)
+		{
+			//near every frame, medium every 2 frames, far every 4 frames. buckets are filled by UpdateLODBuckets this frame
+			for (int32 Level = 0; Level < UE_ARRAY_COUNT(LODBuckets); Level++)
+			{
+				if ((LODUpdateFrameCounter & ((1 << Level) - 1)) != 0)
+					continue;
+
+				for (int32 InstanceIndex : LODBuckets[Level])
+					UpdateAnimation(InstanceIndex, DeltaSeconds);
+			}
+			return;
+		}
+
 		for (int32 InstanceIndex = 0; InstanceIndex < HandleAllocator.GetMaxSize(); InstanceIndex++)
+			UpdateAnimation(InstanceIndex, DeltaSeconds);
+
+	}
+	struct FViewerInfo
+	{
+		FVector Location;
+		float ScreenScale;	//1 / tan(HalfFOV)
+	};
+	typedef TArray<FViewerInfo, TInlineAllocator<4>> FViewerArray;
+	//view points of all player controllers (remote ones included so servers see every player) + registered viewer actors + viewer locations
+	void GatherViewers(FViewerArray& OutViewers)
+	{
+		for (FConstPlayerControllerIterator Iter = GetWorld()->GetPlayerControllerIterator(); Iter; ++Iter)
 		{
-			// Distance-based update throttling for far instances.
-			if (!ShouldUpdateInstanceLOD(InstanceIndex))
+			APlayerController* PC = Iter->Get();
+			if (!PC)
 				continue;
 
-			UpdateAnimation(InstanceIndex, DeltaSeconds);
+			FVector ViewLocation;
+			FRotator ViewRotation;
+			PC->GetPlayerViewPoint(ViewLocation, ViewRotation);
+			const float FOV = PC->PlayerCameraManager ? PC->PlayerCameraManager->GetFOVAngle() : 90.0f;
+			OutViewers.Add(FViewerInfo{ ViewLocation, 1.0f / FMath::Tan(FMath::DegreesToRadians(FMath::Clamp(FOV, 1.0f, 170.0f) * 0.5f)) });
 		}
 
+		ViewerActors.RemoveAllSwap([](const TWeakObjectPtr<AActor>& Viewer) { return !Viewer.IsValid(); });
+		for (const TWeakObjectPtr<AActor>& Viewer : ViewerActors)
+			OutViewers.Add(FViewerInfo{ Viewer->GetActorLocation(), 1.0f });
+
+		for (const FVector& Location : ViewerLocations)
+			OutViewers.Add(FViewerInfo{ Location, 1.0f });
+
+		if (OutViewers.Num())
+			CachedCameraLocation = OutViewers[0].Location;
+	}
+	//sorts alive instances into LODBuckets by distance to the nearest viewer.
+	//grid cells that lie entirely inside one LOD band are assigned as a whole, only instances of straddling cells (or not in the grid yet) are tested one by one.
+	void UpdateLODBuckets()
+	{
+		for (TArray<int32>& Bucket : LODBuckets)
+			Bucket.Reset();
+
+		const int32 NumInstance = GetNumInstance();
+		if (!LODConfig.bEnableLODUpdateFrequency || SignificanceConfig.bEnableSignificance || NumInstance == 0)
+			return;
+
+		SKELOT_SCOPE_CYCLE_COUNTER(UpdateLODBuckets);
+
+		LODUpdateFrameCounter++;
+
+		FViewerArray Viewers;
+		GatherViewers(Viewers);
+		//no viewer (e.g server without players yet), everything is far
+		if (Viewers.Num() == 0)
+			Viewers.Add(FViewerInfo{ FVector(UE_BIG_NUMBER), 1.0f });
+
+		const double MediumDistSq = FMath::Square<double>(LODConfig.MediumDistance);
+		const double FarDistSq = FMath::Square<double>(LODConfig.FarDistance);
+		auto DistSqToLevel = [&](double DistSq) -> uint8 { return DistSq <= MediumDistSq ? 0 : (DistSq <= FarDistSq ? 1 : 2); };
+
+		constexpr uint8 UnknownLevel = 0xFF;
+		TArray<uint8> Levels;
+		Levels.Init(UnknownLevel, NumInstance);
+
+		const EParallelForFlags ParallelFlags = GetNumValidInstance() < GSkelot_MinParallelBatchSize ? EParallelForFlags::ForceSingleThread : EParallelForFlags::None;
+
+		//coarse pass over the grid. grid may be a few frames old (see SpatialGridFrameStride) so cells are padded by one cell size
+		if (bEnableSpatialGrid && SpatialGrid.GetNumCells() != 0)
+		{
+			TArray<TPair<FIntVector, const TArray<int32>*>> Cells;
+			Cells.Reserve(SpatialGrid.GetNumCells());
+			SpatialGrid.ForEachCell([&](const FIntVector& CellKey, const TArray<int32>& CellInstances) { Cells.Emplace(CellKey, &CellInstances); });
+
+			const double CellSize = SpatialGrid.GetCellSize();
+			ParallelFor(Cells.Num(), [&](int32 CellIndex) {
+
+				const FVector CellMin = FVector(Cells[CellIndex].Key) * CellSize - CellSize;
+				const FVector CellMax = CellMin + CellSize * 3;
+				const FBox CellBox(CellMin, CellMax);
+
+				double MinDistSq = UE_BIG_NUMBER;
+				double MaxDistSq = UE_BIG_NUMBER;
+				for (const FViewerInfo& Viewer : Viewers)
+				{
+					MinDistSq = FMath::Min(MinDistSq, CellBox.ComputeSquaredDistanceToPoint(Viewer.Location));
+					const FVector FarCorner = FVector::Max((Viewer.Location - CellMin).GetAbs(), (Viewer.Location - CellMax).GetAbs());
+					MaxDistSq = FMath::Min(MaxDistSq, FarCorner.SizeSquared());
+				}
+
+				const uint8 Level = DistSqToLevel(MinDistSq);
+				if (Level != DistSqToLevel(MaxDistSq))
+					return;
+
+				for (int32 InstanceIndex : *Cells[CellIndex].Value)
+					if (InstanceIndex < NumInstance)
+						Levels[InstanceIndex] = Level;
+
+			}, ParallelFlags);
+		}
+
+		//fine pass for whatever the grid couldn't decide
+		ParallelForEachAliveInstance(EParallelForFlags::None, [&](int32 InstanceIndex, uint8& Level, uint8& OutLevel, const FVector3d& Location) {
+
+			if (Level == UnknownLevel)
+			{
+				double MinDistSq = UE_BIG_NUMBER;
+				for (const FViewerInfo& Viewer : Viewers)
+					MinDistSq = FMath::Min(MinDistSq, FVector::DistSquared(FVector(Location), Viewer.Location));
+
+				Level = DistSqToLevel(MinDistSq);
+			}
+
+			OutLevel = Level;
+
+		}, Levels, SOA.LODLevels, SOA.Locations);
+
+		for (int32 InstanceIndex = 0; InstanceIndex < NumInstance; InstanceIndex++)
+		{
+			if (!SOA.Slots[InstanceIndex].bDestroyed)
+				LODBuckets[SOA.LODLevels[InstanceIndex]].Add(InstanceIndex);
+		}
+	}
+	//computes significance of instances and assigns update tiers under the CPU budget, see FSkelotSignificanceConfig
+	void UpdateSignificance()
+	{
+		const FSkelotSignificanceConfig& Config = SignificanceConfig;
+		const int32 NumInstance = GetNumInstance();
+		if (!Config.bEnableSignificance || NumInstance == 0)
+			return;
+
+		SKELOT_SCOPE_CYCLE_COUNTER(UpdateSignificance);
+
+		//cost model: time spent by the users since last pass divided by the updates we planned for them
+		const float MeasuredMs = static_cast<float>(FPlatformTime::ToMilliseconds64(SignificanceMeasuredCycles));
+		if (SignificancePlannedLoad > 0)
+		{
+			const float Sample = MeasuredMs / SignificancePlannedLoad;
+			SignificanceCostPerUpdateMs = SignificanceCostPerUpdateMs > 0 ? FMath::Lerp(SignificanceCostPerUpdateMs, Sample, 0.1f) : Sample;
+		}
+		SignificanceMeasuredCycles = 0;
+
+		FViewerArray Viewers;
+		GatherViewers(Viewers);
+
+		//score ------------------------------------------------------------------------------------------------------
+		const float WeightSum = Config.DistanceWeight + Config.ScreenSizeWeight + Config.VisibilityWeight + Config.PriorityWeight;
+		const float InvWeightSum = WeightSum > 0 ? 1.0f / WeightSum : 0;
+		const float InvMaxDistance = 1.0f / FMath::Max(1.0f, Config.MaxDistance);
+		const float InvFullScreenSize = 1.0f / FMath::Max(0.001f, Config.FullScoreScreenSize);
+		const EParallelForFlags ParallelFlags = GetNumValidInstance() < GSkelot_MinParallelBatchSize ? EParallelForFlags::ForceSingleThread : EParallelForFlags::None;
+
+		ParallelForEachAliveInstance(EParallelForFlags::None, [&](int32 InstanceIndex, const FSkelotInstancesSOA::FClusterData& CD) {
+
+			const FSkelotInstanceRenderDescFinal& Desc = RenderDescs.Get(CD.GetDescId());
+			const FVector Location = SOA.Locations[InstanceIndex];
+			const float Radius = Desc.BoundRadius * SOA.Scales[InstanceIndex].GetAbsMax();
+
+			float DistanceScore = 0;
+			float ScreenScore = 0;
+			for (const FViewerInfo& Viewer : Viewers)
+			{
+				const float Distance = static_cast<float>(FVector::Dist(Location, Viewer.Location));
+				DistanceScore = FMath::Max(DistanceScore, 1.0f - FMath::Min(1.0f, Distance * InvMaxDistance));
+				ScreenScore = FMath::Max(ScreenScore, FMath::Min(1.0f, Radius * Viewer.ScreenScale / FMath::Max(Distance, 1.0f) * InvFullScreenSize));
+			}
+
+			float VisibilityScore = 0;
+			if (CD.ClusterIdx != -1)
+			{
+				const USKelotClusterComponent* Component = Desc.Clusters.Get(CD.GetClusterId()).Component;
+				VisibilityScore = Component && Component->WasRecentlyRendered(Config.VisibilityGracePeriod) ? 1.0f : 0.0f;
+			}
+
+			const float PriorityScore = SOA.SignificancePriorities[InstanceIndex] * (1.0f / 255.0f);
+
+			SOA.Significances[InstanceIndex] = (DistanceScore * Config.DistanceWeight + ScreenScore * Config.ScreenSizeWeight
+				+ VisibilityScore * Config.VisibilityWeight + PriorityScore * Config.PriorityWeight) * InvWeightSum;
+
+		}, SOA.ClusterData);
+
+		//assign tiers by walking a score histogram from the most significant bucket ---------------------------------
+		constexpr int32 NumBucket = 64;
+		auto ScoreToBucket = [](float Score) { return FMath::Clamp(static_cast<int32>(Score * NumBucket), 0, NumBucket - 1); };
+
+		int32 BucketCounts[NumBucket] = {};
+		int32 NumAlive = 0;
+		int32 NumPinned = 0;
+		for (int32 InstanceIndex = 0; InstanceIndex < NumInstance; InstanceIndex++)
+		{
+			if (SOA.Slots[InstanceIndex].bDestroyed)
+				continue;
+
+			NumAlive++;
+			if (SOA.SignificancePriorities[InstanceIndex] == 255)
+				NumPinned++;
+			else
+				BucketCounts[ScoreToBucket(SOA.Significances[InstanceIndex])]++;
+		}
+
+		const int32 MaxTier = FMath::Clamp(Config.GetMaxTier(), 0, 7);
+		const float MinLoadPerInstance = 1.0f / static_cast<float>(1 << MaxTier);
+		const float Capacity = SignificanceCostPerUpdateMs > 0 ? Config.CPUBudgetMs / SignificanceCostPerUpdateMs : MAX_flt;
+
+		uint8 BucketTiers[NumBucket];
+		float PlannedLoad = static_cast<float>(NumPinned);	//pinned instances ignore the budget
+		int32 NumRemaining = NumAlive - NumPinned;
+		int32 MinTier = 0;
+		for (int32 BucketIndex = NumBucket - 1; BucketIndex >= 0; BucketIndex--)
+		{
+			const int32 Count = BucketCounts[BucketIndex];
+			NumRemaining -= Count;
+
+			//lowest tier that still leaves room for the rest at max tier. tiers never decrease with score.
+			int32 Tier = MinTier;
+			while (Tier < MaxTier && PlannedLoad + Count / static_cast<float>(1 << Tier) + NumRemaining * MinLoadPerInstance > Capacity)
+				Tier++;
+
+			BucketTiers[BucketIndex] = static_cast<uint8>(Tier);
+			PlannedLoad += Count / static_cast<float>(1 << Tier);
+			MinTier = Tier;
+		}
+		SignificancePlannedLoad = PlannedLoad;
+
+		//update masks of this frame ---------------------------------------------------------------------------------
+		const int32 NumWord = FMath::DivideAndRoundUp(NumInstance, 64);
+		const int32 UserMaxTiers[] = { Config.AnimationMaxTier, Config.RVOMaxTier, Config.PBDMaxTier };
+		static_assert(UE_ARRAY_COUNT(UserMaxTiers) == (int32)ESkelotSignificanceUser::Num);
+
+		for (TArray<uint64>& Mask : SOA.SignificanceUpdateMasks)
+			Mask.SetNumUninitialized(SOA.Slots.Num() / 64);
+
+		ParallelFor(NumWord, [&](int32 WordIndex) {
+
+			const int32 Start = WordIndex * 64;
+			const int32 End = FMath::Min(Start + 64, NumInstance);
+			//tail bits belong to slots that may be allocated before the next pass
+			const uint64 TailBits = End - Start < 64 ? (MAX_uint64 << (End - Start)) : 0;
+			uint64 Bits[(int32)ESkelotSignificanceUser::Num] = { TailBits, TailBits, TailBits };
+
+			for (int32 InstanceIndex = Start; InstanceIndex < End; InstanceIndex++)
+			{
+				const uint64 Bit = uint64(1) << (InstanceIndex - Start);
+				//destroyed slots update every frame so instances created into them before the next pass aren't throttled
+				if (SOA.Slots[InstanceIndex].bDestroyed || SOA.SignificancePriorities[InstanceIndex] == 255)
+				{
+					SOA.SignificanceTiers[InstanceIndex] = 0;
+					for (uint64& UserBits : Bits)
+						UserBits |= Bit;
+					continue;
+				}
+
+				const uint8 Tier = BucketTiers[ScoreToBucket(SOA.Significances[InstanceIndex])];
+				SOA.SignificanceTiers[InstanceIndex] = Tier;
+				for (int32 UserIndex = 0; UserIndex < (int32)ESkelotSignificanceUser::Num; UserIndex++)
+				{
+					if (FSkelotInstancesSOA::IsTierUpdateFrame(FMath::Min<int32>(Tier, UserMaxTiers[UserIndex]), InstanceIndex, GFrameCounter))
+						Bits[UserIndex] |= Bit;
+				}
+			}
+
+			for (int32 UserIndex = 0; UserIndex < (int32)ESkelotSignificanceUser::Num; UserIndex++)
+				SOA.SignificanceUpdateMasks[UserIndex][WordIndex] = Bits[UserIndex];
+
+		}, ParallelFlags);
+
+		//words beyond NumInstance belong to slots that are allocated later this frame
+		for (TArray<uint64>& Mask : SOA.SignificanceUpdateMasks)
+			for (int32 WordIndex = NumWord; WordIndex < Mask.Num(); WordIndex++)
+				Mask[WordIndex] = MAX_uint64;
 	}
 
 	void UpdateAnimation(int32 InstanceIndex, float Delta)
@@ -320,29 +678,58 @@ public:
 		float NewDelta = AnimData.AnimationPlayRate * Delta;
 		float AssetLength = AnimData.CurrentAsset->GetPlayLength();
 		float AnimPos;
+		float OldAnimPos;
+		//part of the sequence that is played, a composite segment may use only a range of it
+		const FAnimSegment* PlayedSegment = nullptr;
 		ETypeAdvanceAnim result = SkelotAnimAdvanceTime(Slot.bAnimationLooped, NewDelta, AnimData.AnimationTime, AssetLength);
 		
 		check(AnimData.IsSequenceValid() && AnimData.CurrentAsset);
 
 		if (Slot.bExtractRootMotion) //maybe AnimData.CurrentAsset->HasRootMotion() ?
 		{
-			FAnimExtractContext Context(static_cast<double>(OldTime), true, FDeltaTimeRecord(NewDelta), Slot.bAnimationLooped);
-			FTransform3f RMT = (FTransform3f)AnimData.CurrentAsset->ExtractRootMotion(Context);
-			SOA.RootMotions[InstanceIndex] = RMT * SOA.RootMotions[InstanceIndex];
+			const FSkelotSequenceDef& CurrentSequenceStruct = AnimCollection->Sequences[AnimData.AnimationCurrentSequence];
+			FTransform3f RMT;
+			//sequences are looked up from the baked track, composites still extract from the asset
+			if (CurrentSequenceStruct.RootMotionTrack.Num() && CurrentSequenceStruct.Sequence == AnimData.CurrentAsset)
+			{
+				RMT = CurrentSequenceStruct.ExtractBakedRootMotion(OldTime, NewDelta, Slot.bAnimationLooped);
+			}
+			else
+			{
+				FAnimExtractContext Context(static_cast<double>(OldTime), true, FDeltaTimeRecord(NewDelta), Slot.bAnimationLooped);
+				RMT = (FTransform3f)AnimData.CurrentAsset->ExtractRootMotion(Context);
+			}
+			FTransform3f& RootMotion = SOA.RootMotions[InstanceIndex];
+			RootMotion = RMT * RootMotion;
 		}
 
-		if (AnimData.CurrentAsset->GetClass() == UAnimComposite::StaticClass())
+		if (AnimData.IsCompositeValid())
 		{
 			const UAnimComposite* CompositeAsset = static_cast<UAnimComposite*>(AnimData.CurrentAsset);
-			//AssetLength = CompositeAsset->AnimationTrack.GetLength();
-			const FAnimSegment* OldSegment = CompositeAsset->AnimationTrack.GetSegmentAtTime(OldTime);
-			const FAnimSegment* NewSegment = CompositeAsset->AnimationTrack.GetSegmentAtTime(AnimData.AnimationTime);
-			check(OldSegment && NewSegment);
+			//composite defs are dropped when the collection rebuilds, the cached index may be out of range or point to another composite
+			if (!AnimCollection->CompositeDefs.IsValidIndex(AnimData.AnimationCompositeIndex) || AnimCollection->CompositeDefs[AnimData.AnimationCompositeIndex].Composite != CompositeAsset)
+			{
+				const int32 CompositeDefIndex = AnimCollection->FindOrAddCompositeDef(CompositeAsset);
+				if (CompositeDefIndex == -1)
+				{
+					UE_LOGFMT(LogSkelot, Warning, "Pausing {0}. AnimComposite has unregistered segments in {1}", GetDbgFName(CompositeAsset), GetDbgFName(AnimCollection));
+					Slot.bAnimationPaused = true;
+					return;
+				}
+				AnimData.AnimationCompositeIndex = static_cast<uint16>(CompositeDefIndex);
+				AnimData.AnimationCurrentSegment = static_cast<uint16>(AnimCollection->CompositeDefs[CompositeDefIndex].FindSegment(OldTime, 0));
+			}
+			const USkelotAnimCollection::FCompositeDef& CompositeDef = AnimCollection->CompositeDefs[AnimData.AnimationCompositeIndex];
+			const int32 OldSegmentIndex = AnimData.AnimationCurrentSegment;
+			const int32 NewSegmentIndex = CompositeDef.FindSegment(AnimData.AnimationTime, OldSegmentIndex);
+			const FAnimSegment* OldSegment = &CompositeAsset->AnimationTrack.AnimSegments[OldSegmentIndex];
+			const FAnimSegment* NewSegment = &CompositeAsset->AnimationTrack.AnimSegments[NewSegmentIndex];
 			if (OldSegment != NewSegment)
 			{
-				uint16 NewSeqDefIndex = static_cast<uint16>(AnimCollection->FindSequenceDef(NewSegment->GetAnimReference()));
-				check(NewSeqDefIndex != AnimData.AnimationCurrentSequence && NewSeqDefIndex != 0xFFff);
-				AnimData.AnimationCurrentSequence = NewSeqDefIndex;
+				AnimData.AnimationCurrentSegment = static_cast<uint16>(NewSegmentIndex);
+				AnimData.AnimationCurrentSequence = CompositeDef.SegmentSequences[NewSegmentIndex];
+				//notifies of a new segment are evaluated from its start
+				Slot.bNotifyFromRangeStart = true;
 
 				//if segment changed then transition is not valid anymore
 				if (AnimData.IsTransitionValid())
@@ -352,12 +739,15 @@ public:
 			}
 
 			AnimPos = NewSegment->ConvertTrackPosToAnimPos(AnimData.AnimationTime);
+			OldAnimPos = OldSegment != NewSegment ? NewSegment->AnimStartTime : NewSegment->ConvertTrackPosToAnimPos(OldTime);
+			PlayedSegment = NewSegment;
 
 		}
 		else
 		{
 			const UAnimSequence* SequenceAsset = reinterpret_cast<UAnimSequence*>(AnimData.CurrentAsset);
 			AnimPos = AnimData.AnimationTime;
+			OldAnimPos = OldTime;
 		}
 
 		const FSkelotSequenceDef& ActiveSequenceStruct = AnimCollection->Sequences[AnimData.AnimationCurrentSequence];
@@ -367,34 +757,47 @@ public:
 		int32 GlobalFrameIndex = ActiveSequenceStruct.AnimationFrameIndex + LocalFrameIndex;
 		check(GlobalFrameIndex < AnimCollection->FrameCountSequences);
 
-		if(ActiveSequenceStruct.Sequence->IsNotifyAvailable())
+		//an instance held at the same position doesn't re-trigger the notifies of its frame
+		if (ActiveSequenceStruct.NotifyFrames.Num() && AnimPos != OldAnimPos)
 		{
-			AnimationNotifyContext.ActiveNotifies.Reset();
-			ActiveSequenceStruct.Sequence->GetAnimNotifies(OldTime, NewDelta, AnimationNotifyContext);
-			for (const FAnimNotifyEventReference& Ev : AnimationNotifyContext.ActiveNotifies)
-			{
-				const FAnimNotifyEvent* NotifyEv = Ev.GetNotify(); 
-				check(NotifyEv);
-				const bool bHasChance = FMath::FRandRange(0.f, 1.f) < NotifyEv->NotifyTriggerChance;
-				if(bHasChance)
+			auto AddNotifyEvent = [&](const FSkelotNotifyFrame& NotifyFrame) {
+				if (NotifyFrame.ChanceThreshold != MAX_uint32 && SOA.NextInstanceRandom(InstanceIndex) >= NotifyFrame.ChanceThreshold)
+					return;
+
+				const FSkelotAnimNotifyDesc& NotifyDesc = ActiveSequenceStruct.Notifies[NotifyFrame.NotifyIndex];
+				if (NotifyDesc.NotifyInterface)
 				{
-					if (NotifyEv->Notify)
-					{
-						if(bEnableAnimNotifyObjects)
-						{
-							if (ISkelotNotifyInterface* SkelotNotify = Cast<ISkelotNotifyInterface>(NotifyEv->Notify))
-							{
-								AnimationNotifyObjectEvents.Add(FSkelotAnimNotifyObjectEvent{ this->IndexToHandle(InstanceIndex), ActiveSequenceStruct.Sequence, SkelotNotify });
-							}
-						}
-					}
-					else
-					{
-						AnimationNotifyEvents.Add(FSkelotAnimNotifyEvent{ this->IndexToHandle(InstanceIndex), ActiveSequenceStruct.Sequence,  NotifyEv->NotifyName });
-					}
+					if (bEnableAnimNotifyObjects)
+						AnimationNotifyObjectEvents.Add(FSkelotAnimNotifyObjectEvent{ this->IndexToHandle(InstanceIndex), ActiveSequenceStruct.Sequence, NotifyDesc.NotifyInterface });
 				}
+				else
+				{
+					AnimationNotifyEvents.Add(FSkelotAnimNotifyEvent{ this->IndexToHandle(InstanceIndex), ActiveSequenceStruct.Sequence, NotifyDesc.Name });
+				}
+			};
+
+			auto PosToLocalFrame = [&](float Pos) { return FMath::Clamp(FMath::TruncToInt32(Pos * ActiveSequenceStruct.SampleFrequency), 0, ActiveSequenceStruct.AnimationFrameCount - 1); };
+
+			//frame range played, first one is exclusive. a composite segment only plays [AnimStartTime, AnimEndTime] of its sequence
+			const int32 RangeFirstFrame = PlayedSegment ? PosToLocalFrame(PlayedSegment->AnimStartTime) - 1 : -1;
+			const int32 RangeLastFrame = PlayedSegment ? PosToLocalFrame(PlayedSegment->AnimEndTime) : ActiveSequenceStruct.AnimationFrameCount - 1;
+
+			//notifies trigger when their frame is entered. the first update after play or segment entry includes the frame it started at
+			const bool bFromRangeStart = Slot.bNotifyFromRangeStart;
+			const int32 OldLocalFrameIndex = bFromRangeStart ? FMath::Max(PosToLocalFrame(OldAnimPos) - 1, RangeFirstFrame) : PosToLocalFrame(OldAnimPos);
+			if (AnimPos < OldAnimPos) //looped ?
+			{
+				ActiveSequenceStruct.ForEachNotifyInFrameRange(OldLocalFrameIndex, RangeLastFrame, AddNotifyEvent);
+				ActiveSequenceStruct.ForEachNotifyInFrameRange(RangeFirstFrame, LocalFrameIndex, AddNotifyEvent);
+			}
+			else
+			{
+				ActiveSequenceStruct.ForEachNotifyInFrameRange(OldLocalFrameIndex, LocalFrameIndex, AddNotifyEvent);
 			}
 		}
+
+		if (AnimPos != OldAnimPos)
+			Slot.bNotifyFromRangeStart = false;
 		
 
 
@@ -410,7 +813,17 @@ public:
 			{
 				int32 TransitionLFI = LocalFrameIndex - Transition.ToFI;
 				check(TransitionLFI < Transition.FrameCount);
-				SetAnimFrame(InstanceIndex, Transition.FrameIndex + TransitionLFI);
+				if (Transition.bReady)
+				{
+					SetAnimFrame(InstanceIndex, Transition.FrameIndex + TransitionLFI);
+				}
+				else //still being generated, continue the source sequence (blend weight 0 of the same timeline)
+				{
+					const FSkelotSequenceDef& FromSequenceStruct = AnimCollection->Sequences[Transition.FromSI];
+					int32 FromLFI = Transition.FromFI + TransitionLFI;
+					FromLFI = Transition.bFromLoops ? FromLFI % FromSequenceStruct.AnimationFrameCount : FMath::Min(FromLFI, FromSequenceStruct.AnimationFrameCount - 1);
+					SetAnimFrame(InstanceIndex, FromSequenceStruct.AnimationFrameIndex + FromLFI);
+				}
 				return;
 			}
 		}
@@ -444,11 +857,75 @@ public:
 	{
 		SKELOT_SCOPE_CYCLE_COUNTER(CalculateBounds);
 
-		for (int32 InstanceIndex = 0; InstanceIndex < HandleAllocator.GetMaxSize(); InstanceIndex++)
+		const EParallelForFlags ParallelFlags = GetNumValidInstance() < GSkelot_MinParallelBatchSize ? EParallelForFlags::ForceSingleThread : EParallelForFlags::None;
+
+		//grow the bound of clusters by instances moved this frame ---------------------------------------------------
+		TArray<int32> MovedInstances;
+		SOA.ForEachTransformDirty(GetNumInstance(), [&](int32 InstanceIndex) {
+			if (!SOA.Slots[InstanceIndex].bDestroyed && SOA.ClusterData[InstanceIndex].ClusterIdx != -1)
+				MovedInstances.Add(InstanceIndex);
+		});
+
+		TArray<FBox> MovedBounds;
+		MovedBounds.SetNumUninitialized(MovedInstances.Num());
+		ParallelFor(MovedInstances.Num(), [&](int32 Index) {
+			MovedBounds[Index] = CalcInstanceBoundFast(MovedInstances[Index]);
+		}, ParallelFlags);
+
+		for (int32 Index = 0; Index < MovedInstances.Num(); Index++)
 		{
-			FSkelotInstancesSOA::FSlotData& Slot = SOA.Slots[InstanceIndex];
-			FSkelotInstancesSOA::FAnimData& AnimData = SOA.AnimDatas[InstanceIndex];
+			const FSkelotInstancesSOA::FClusterData& CD = SOA.ClusterData[MovedInstances[Index]];
+			FSkelotCluster& ClusterRef = RenderDescs.Get(CD.GetDescId()).Clusters.Get(CD.GetClusterId());
+			ClusterRef.Bounds += MovedBounds[Index];
+			ClusterRef.bBoundsMayShrink = true;
 		}
+
+		//shrink lazily, clusters are rebuilt from scratch spread over frames ---------------------------------------
+		const uint32 ShrinkInterval = static_cast<uint32>(FMath::Max(1, GSkelot_ClusterBoundsShrinkInterval));
+		TArray<FSkelotCluster*, TInlineAllocator<64>> ClustersToRebuild;
+		for (FSkelotInstanceRenderDescFinal& DescRef : RenderDescs)
+		{
+			for (auto ClusterIter = DescRef.Clusters.CreateIterator(); ClusterIter; ++ClusterIter)
+			{
+				if (ClusterIter->bBoundsMayShrink && ((GFrameCounter + ClusterIter.GetId().AsInteger()) % ShrinkInterval) == 0)
+					ClustersToRebuild.Add(&*ClusterIter);
+			}
+		}
+
+		ParallelFor(ClustersToRebuild.Num(), [&](int32 Index) {
+			FSkelotCluster& ClusterRef = *ClustersToRebuild[Index];
+			FBox NewBounds(ForceInit);
+			for (int32 InstanceIndex : ClusterRef.Instances)
+				NewBounds += CalcInstanceBoundFast(InstanceIndex);
+
+			ClusterRef.Bounds = NewBounds;
+			ClusterRef.bBoundsMayShrink = false;
+		});
+	}
+	//conservative world bound of an instance, sphere of the desc bound radius scaled by the largest scale axis
+	FBox CalcInstanceBoundFast(int32 InstanceIndex) const
+	{
+		const FSkelotInstanceRenderDescFinal& Desc = RenderDescs.Get(SOA.ClusterData[InstanceIndex].GetDescId());
+		const double Radius = Desc.BoundRadius * SOA.Scales[InstanceIndex].GetAbsMax();
+		return FBox::BuildAABB(SOA.Locations[InstanceIndex], FVector(Radius));
+	}
+	//
+	static float CalcDescBoundRadius(const FSkelotInstanceRenderDesc& Desc)
+	{
+		if (!Desc.AnimCollection)
+			return 0;
+
+		FBox LocalBound(ForceInit);
+		for (int32 MeshDefIndex : Desc.CachedMeshDefIndices)
+		{
+			if (MeshDefIndex != -1)
+				LocalBound += FBox(Desc.AnimCollection->Meshes[MeshDefIndex].MaxBBox.ToBox());
+		}
+
+		if (!LocalBound.IsValid)
+			LocalBound = FBox(Desc.AnimCollection->MeshesBBox.GetFBox());
+
+		return static_cast<float>(FVector::Max(LocalBound.Min.GetAbs(), LocalBound.Max.GetAbs()).Size());
 	}
 	/*
 	*/
@@ -466,35 +943,31 @@ public:
 
 		TArray<FPack, TInlineAllocator<32>> Packs;
 
-		//for each render desc --------------------------------------------
-		for (auto DescIter = RenderDescs.CreateIterator(); DescIter; ++DescIter)
-		{
-			if (!DescIter->bMayHaveNegativeDeterminant)
-				continue;
+		//only instances whose transform was written this frame may have flipped their determinant
+		SOA.ForEachTransformDirty(GetNumInstance(), [&](int32 InstanceIndex) {
 
-			FPack* Changelist = nullptr;
+			if (SOA.Slots[InstanceIndex].bDestroyed)
+				return;
 
-			//for each cluster --------------------------------------------
-			for (FSkelotCluster& ClusterIter : DescIter->Clusters)
+			const FSetElementId DescId = SOA.ClusterData[InstanceIndex].GetDescId();
+			const FSkelotInstanceRenderDescFinal& Desc = RenderDescs.Get(DescId);
+			if (!Desc.bMayHaveNegativeDeterminant)
+				return;
+
+			const FVector3f& Scale = SOA.Scales[InstanceIndex];
+			const bool bInstanceDeterminantNegative = (Scale.X * Scale.Y * Scale.Z) < 0; //check if determinant is negative, see FTransform::GetDeterminant
+			if (Desc.bIsNegativeDeterminant != bInstanceDeterminantNegative) //determinant sign changed ?
 			{
-				//for each instance in the cluster ----------------------------
-				for (int32 InstanceIndex : ClusterIter.Instances)
+				FPack* Changelist = Packs.FindByPredicate([&](const FPack& Pack) { return Pack.DescId == DescId; });
+				if (!Changelist)
 				{
-					const FVector3f& Scale = SOA.Scales[InstanceIndex];
-					const bool bInstanceDeterminantNegative = (Scale.X * Scale.Y * Scale.Z) < 0; //check if determinant is negative, see FTransform::GetDeterminant
-					if (DescIter->bIsNegativeDeterminant != bInstanceDeterminantNegative) //determinant sign changed ?
-					{
-						if (!Changelist)
-						{
-							Changelist = &Packs.AddDefaulted_GetRef();
-							Changelist->DescId = DescIter.GetId();
-						}
-
-						Changelist->InstanceIndices.Add(InstanceIndex);
-					}
+					Changelist = &Packs.AddDefaulted_GetRef();
+					Changelist->DescId = DescId;
 				}
+
+				Changelist->InstanceIndices.Add(InstanceIndex);
 			}
-		}
+		});
 
 		for (FPack& Pack : Packs)
 		{
@@ -574,6 +1047,8 @@ public:
 		checkSlow(!ClusterRef.Instances.Contains(InstanceIndex));
 		CD.RenderIdx = ClusterRef.Instances.Add(InstanceIndex);
 		ClusterRef.bAnyAddRemove = true;
+		//let CalculateBounds grow the cluster bound by this instance
+		SOA.MarkTransformDirty(InstanceIndex);
 
 		if (!ClusterRef.Component->IsRegistered())
 		{
@@ -587,60 +1062,18 @@ public:
 	{
 		check(RenderIndex != -1);
 		ClusterRef.bAnyAddRemove = true;
+		ClusterRef.bBoundsMayShrink = true;
 		int32 LastInstanceIndex = ClusterRef.Instances.Last();	//instance index of the last element in the cluster
 		this->SOA.ClusterData[LastInstanceIndex].RenderIdx = RenderIndex;
 		ClusterRef.Instances[RenderIndex] = LastInstanceIndex;
 		ClusterRef.Instances.Pop(EAllowShrinking::No);
 	}
-	/*
-	*/
-	void UpdateClusters(FSkelotInstanceRenderDescFinal& Desc, FSetElementId DescId)
-	{
-		struct FPointAndIndex { FIntPoint Coord; int32 InstanceIndex; };
-
-		TStackIncrementalArrayWithMark<FPointAndIndex, 128> Changelist;
-
-		//for each cluster in render desc ----------------------------------
-		for (auto ClusterIter = Desc.Clusters.CreateIterator(); ClusterIter; ++ClusterIter)
-		{
-			FSkelotCluster& CurCluster = *ClusterIter;
-			//for each instance in the cluster --------------------------------------------
-			for (int32 RenderIdx = 0; RenderIdx < CurCluster.Instances.Num();)
-			{
-				int32 InstanceIndex = CurCluster.Instances[RenderIdx];
-
-				FSkelotInstancesSOA::FClusterData& CD = SOA.ClusterData[InstanceIndex];
-				check(CD.DescIdx == DescId.AsInteger());
-				check(CD.ClusterIdx != -1 && CD.RenderIdx != -1 && CD.RenderIdx == RenderIdx);
-				FIntPoint NewTileCoord = LocationToTileCoord(SOA.Locations[InstanceIndex]);
-
-				if (NewTileCoord != CurCluster.Coord) //tile coordinate has changed ?
-				{
-					RemoveInstanceFromCluster(CurCluster, RenderIdx);
-					CD.ClusterIdx = -1;
-					CD.RenderIdx = -1;
-					Changelist.Add(FPointAndIndex{ NewTileCoord, InstanceIndex });
-				}
-				else
-				{
-					RenderIdx++;
-				}
-			}
-		}
-
-		Changelist.ForEach([&](FPointAndIndex Data) {
-
-			BindInstanceToCluster(Data.InstanceIndex, Data.Coord);
-			if (GSkelot_DebugClusters)
-				DebugDrawInstanceBound(Data.InstanceIndex, FMath::FRandRange(-10.0f, 10.0f), FColor::Magenta, false, 0.3f);
-		});
-	}
-
-
 	/*
 	*/
 	void UpdateClusters()
 	{
+		SKELOT_SCOPE_CYCLE_COUNTER(UpdateClusters);
+
 		if (ClusterMode == ESkelotClusterMode::None)
 		{
 			// loop over those instances that need to be assigned to a cluster ------------------------------------------------------
@@ -660,16 +1093,31 @@ public:
 			}
 			InstancesNeedCluster.Reset();
 
+			// migrate instances that moved to another tile this frame, only those whose transform was written are checked ---------
+			SOA.ForEachTransformDirty(GetNumInstance(), [&](int32 InstanceIndex) {
 
-			if (++ClusterUpdateCounter == 32)
-			{
-				ClusterUpdateCounter = 0;
+				if (SOA.Slots[InstanceIndex].bDestroyed)
+					return;
+
+				FSkelotInstancesSOA::FClusterData& CD = SOA.ClusterData[InstanceIndex];
+				if (CD.ClusterIdx == -1)
+					return;
+
+				FSkelotCluster& CurCluster = RenderDescs.Get(CD.GetDescId()).Clusters.Get(CD.GetClusterId());
+				check(CurCluster.Instances[CD.RenderIdx] == InstanceIndex);
+				const FIntPoint NewTileCoord = LocationToTileCoord(SOA.Locations[InstanceIndex]);
 
-				for (auto Iter = this->RenderDescs.CreateIterator(); Iter; ++Iter)
+				if (NewTileCoord != CurCluster.Coord) //tile coordinate has changed ?
 				{
-					UpdateClusters(*Iter, Iter.GetId());
+					RemoveInstanceFromCluster(CurCluster, CD.RenderIdx);
+					CD.ClusterIdx = -1;
+					CD.RenderIdx = -1;
+
+					BindInstanceToCluster(InstanceIndex, NewTileCoord);
+					if (GSkelot_DebugClusters)
+						DebugDrawInstanceBound(InstanceIndex, FMath::FRandRange(-10.0f, 10.0f), FColor::Magenta, false, 0.3f);
 				}
-			}
+			});
 		}
 	}
 	/*
@@ -777,30 +1225,43 @@ public:
 		return FVector((Coord.X + 0.5) * TileSize, (Coord.Y + 0.5) * TileSize, 0);
 	}
 	//
-	void LowLevelDestroyInstance(int32 InstanceIndex)
+	void LowLevelDestroyInstance(int32 InstanceIndex, bool bRemoveFromPendingClusters = true)
 	{
 		FSkelotInstancesSOA::FSlotData& Slot = SOA.Slots[InstanceIndex];
 
 		ResetAnimationState(InstanceIndex);
 
 		//remove attachment data if any
-		int32& AttachmentIdx = SOA.MiscData[InstanceIndex].AttachmentIndex;
-		if (AttachmentIdx != -1)
+		FSkelotInstancesSOA::FMiscData* MiscData = SOA.MiscData.Find(InstanceIndex);
+		if (MiscData && MiscData->AttachmentIndex != -1)
 		{
-			AttachParentArray.RemoveAt(AttachmentIdx);
-			AttachmentIdx = -1;
+			AttachParentArray.RemoveAt(MiscData->AttachmentIndex);
+			MiscData->AttachmentIndex = -1;
+			bHierarchyOrderDirty = true;
+		}
+
+		RemoveInstanceFromGroup(InstanceIndex);
+
+		//heap entries of the handle become stale and are dropped when they reach the top
+		if (LifeSpanMap.Num() || TimerMap.Num())
+		{
+			const FSkelotInstanceHandle Handle = IndexToHandle(InstanceIndex);
+			LifeSpanMap.Remove(Handle);
+			TimerMap.Remove(Handle);
 		}
-		
 
 		HandleAllocator.Free(InstanceIndex);
 		Slot.IncVersion();
 		Slot.bDestroyed = true;
+		SOA.SetAliveBit(InstanceIndex, false);
 		
 
 		DestructItem(&SOA.AnimDatas[InstanceIndex]);
 
 		if(SOA.UserObjects.Num() != 0)
 			SOA.UserObjects[InstanceIndex] = nullptr;
+		if(SOA.SparseUserObjects.Num() != 0)
+			SOA.SparseUserObjects.Remove(InstanceIndex);
 
 		FSkelotInstancesSOA::FClusterData& CD = SOA.ClusterData[InstanceIndex];
 		check(CD.DescIdx != -1);
@@ -808,7 +1269,9 @@ public:
 		if (CD.ClusterIdx == -1) //happens if we add and remove at same frame ! rare !
 		{
 			check(CD.RenderIdx == -1);
-			InstancesNeedCluster.RemoveAtSwap(InstancesNeedCluster.IndexOfByKey(InstanceIndex), EAllowShrinking::No);
+			//batch destroy filters InstancesNeedCluster once at the end, see RemoveDestroyedFromPendingClusters
+			if (bRemoveFromPendingClusters)
+				InstancesNeedCluster.RemoveAtSwap(InstancesNeedCluster.IndexOfByKey(InstanceIndex), EAllowShrinking::No);
 		}
 		else
 		{
@@ -820,6 +1283,28 @@ public:
 
 		CD.DescIdx = -1;
 	}
+	//swap removes the instance from its group member list
+	void RemoveInstanceFromGroup(int32 InstanceIndex)
+	{
+		FSkelotInstancesSOA::FGroupData& GroupData = SOA.Groups[InstanceIndex];
+		if (GroupData.GroupId == -1)
+			return;
+
+		TArray<int32>& Members = GroupMembers.FindChecked(GroupData.GroupId);
+		check(Members[GroupData.MemberIndex] == InstanceIndex);
+		Members.RemoveAtSwap(GroupData.MemberIndex, EAllowShrinking::No);
+		if (Members.IsValidIndex(GroupData.MemberIndex))
+			SOA.Groups[Members[GroupData.MemberIndex]].MemberIndex = GroupData.MemberIndex;
+		if (Members.Num() == 0)
+			GroupMembers.Remove(GroupData.GroupId);
+
+		GroupData = FSkelotInstancesSOA::FGroupData();
+	}
+	//
+	void RemoveDestroyedFromPendingClusters()
+	{
+		InstancesNeedCluster.RemoveAllSwap([this](int32 InstanceIndex) { return SOA.Slots[InstanceIndex].bDestroyed; }, EAllowShrinking::No);
+	}
 	
 
 
@@ -831,22 +1316,86 @@ public:
 	{
 		SKELOT_SCOPE_CYCLE_COUNTER(UpdateHierarchyTransforms);
 
-		//socket transform of those who are playing transition must be ready by now
-		for (auto DescIter = RenderDescs.CreateIterator(); DescIter; ++DescIter)
+		//#Note instances only reference transition frames that are ready, so socket transforms are always valid
+
+		if (bHierarchyOrderDirty)
+		{
+			RebuildHierarchyOrder();
+		}
+
+		//each depth is resolved in parallel, parents of a depth were written by the previous one
+		for (int32 Depth = 0; Depth + 1 < HierarchyDepthOffsets.Num(); Depth++)
+		{
+			const int32 Start = HierarchyDepthOffsets[Depth];
+			const int32 Num = HierarchyDepthOffsets[Depth + 1] - Start;
+
+			ParallelFor(Num, [this, Start](int32 Index) {
+				const FSkelotAttachParentData& ChildFrag = AttachParentArray[SOA.MiscData.Get(HierarchyOrder[Start + Index]).AttachmentIndex];
+				UpdateChildTransform(AttachParentArray[SOA.MiscData.Get(ChildFrag.Parent).AttachmentIndex], ChildFrag);
+			}, Num < GSkelot_MinParallelBatchSize ? EParallelForFlags::ForceSingleThread : EParallelForFlags::None);
+		}
+	}
+	//
+	void UpdateChildTransform(const FSkelotAttachParentData& ParentFrag, const FSkelotAttachParentData& ChildFrag)
+	{
+		//mul order is == RelT * SocketT * BoneT * ParentInstanceT
+		FTransform3f ChildT = ChildFrag.RelativeTransform;
+		if (ChildFrag.SocketPtr)
+			ChildT *= (FTransform3f)ChildFrag.SocketPtr->GetSocketLocalTransform();
+
+		ChildT *= GetInstanceBoneTransformCS(ParentFrag.InstanceIndex, ChildFrag.SocketBoneIndex);
+
+		SetInstanceTransform(ChildFrag.InstanceIndex, FTransform(ChildT) * GetInstanceTransform(ParentFrag.InstanceIndex));
+	}
+	/*
+	flatten the attachment trees breadth first. only instances that have a parent end up in the list, roots and detached instances are never touched.
+	*/
+	void RebuildHierarchyOrder()
+	{
+		SKELOT_SCOPE_CYCLE_COUNTER(RebuildHierarchyOrder);
+
+		bHierarchyOrderDirty = false;
+		HierarchyOrder.Reset();
+		HierarchyDepthOffsets.Reset();
+
+		//depth 0 are the roots, they are not stored
+		TArray<int32> Parents;
+		for (const FSkelotAttachParentData& AtchData : AttachParentArray)
 		{
-			if (DescIter->AnimCollection)
-			{
-				DescIter->AnimCollection->FlushDeferredTransitions();
-			}
+			if (AtchData.Parent == -1 && AtchData.FirstChild != -1 && IsInstanceAlive(AtchData.InstanceIndex))
+				Parents.Add(AtchData.InstanceIndex);
 		}
 
-		for (FSkelotAttachParentData& AtchData : AttachParentArray)
+		int32 RemainingChildren = SOA.Slots.Num();
+		while (Parents.Num())
 		{
-			if (AtchData.Parent == -1) //no parent means its root
+			const int32 LevelStart = HierarchyOrder.Num();
+			HierarchyDepthOffsets.Add(LevelStart);
+
+			for (int32 ParentIdx : Parents)
+			{
+				for (int32 ChildIdx = AttachParentArray[SOA.MiscData.Get(ParentIdx).AttachmentIndex].FirstChild; ChildIdx != -1 && RemainingChildren-- > 0;)
+				{
+					const FSkelotAttachParentData* ChildFrag = GetInstanceAttachParentData(ChildIdx);
+					if (!ChildFrag || ChildFrag->InstanceIndex != ChildIdx)
+						break;
+
+					HierarchyOrder.Add(ChildIdx);
+					ChildIdx = ChildFrag->Down;
+				}
+			}
+
+			//children of this depth are parents of the next one
+			Parents.Reset();
+			for (int32 Index = LevelStart; Index < HierarchyOrder.Num(); Index++)
 			{
-				UpdateChildTransforms(AtchData);
+				if (AttachParentArray[SOA.MiscData.Get(HierarchyOrder[Index]).AttachmentIndex].FirstChild != -1)
+					Parents.Add(HierarchyOrder[Index]);
 			}
 		}
+
+		if (HierarchyDepthOffsets.Num())
+			HierarchyDepthOffsets.Add(HierarchyOrder.Num());
 	}
 
 #pragma endregion
@@ -945,6 +1494,119 @@ public:
 		Desc.AnimCollection->CalcRenderMatrices(FullPose, RenderMatrices);
 	}
 
+	/*
+	move instances that opted in by their SOA velocity, Location += Velocity * Dt.
+	a streaming pass over the SOA columns in chunks, velocities are already solved by RVO/PBD at this point.
+	one shot advances of AdvanceInstancesByVelocity are applied after it and replace the pass for their instances.
+	*/
+	void IntegrateVelocities(float DeltaSeconds)
+	{
+		SKELOT_SCOPE_CYCLE_COUNTER(IntegrateVelocities);
+
+		static const int32 ChunkSize = 1024;
+		const int32 NumInstance = GetNumInstance();
+		const int32 NumChunk = DeltaSeconds > 0 ? FMath::DivideAndRoundUp(NumInstance, ChunkSize) : 0;
+		const bool bWithGroundSnap = OnGroundSnap.IsBound();
+		const VectorRegister4Double DeltaReg = VectorSetFloat1(static_cast<double>(DeltaSeconds));
+
+		TArray<TArray<int32>, TInlineAllocator<16>> ChunkSnapInstances;
+		ChunkSnapInstances.SetNum(bWithGroundSnap ? NumChunk : 0);
+
+		ParallelFor(NumChunk, [&](int32 ChunkIndex) {
+
+			const int32 Start = ChunkIndex * ChunkSize;
+			const int32 End = FMath::Min(Start + ChunkSize, NumInstance);
+			for (int32 InstanceIndex = Start; InstanceIndex < End; InstanceIndex++)
+			{
+				const FSkelotInstancesSOA::FSlotData& Slot = SOA.Slots[InstanceIndex];
+				if (Slot.bDestroyed | !Slot.bIntegrateVelocity | Slot.bIntegrateVelocityOnce)
+					continue;
+
+				const FVector3f& Velocity = SOA.Velocities[InstanceIndex];
+				double* Location = &SOA.Locations[InstanceIndex].X;
+				const VectorRegister4Double VelocityReg = VectorRegister4Double(VectorLoadFloat3(&Velocity.X));
+				VectorStoreDouble3(VectorMultiplyAdd(VelocityReg, DeltaReg, VectorLoadDouble3(Location)), Location);
+				SOA.MarkTransformDirty(InstanceIndex);
+
+				if (Slot.bFaceVelocity && !Velocity.IsNearlyZero())
+				{
+					SOA.Rotations[InstanceIndex] = FQuat4f(FRotationMatrix::MakeFromX(FVector(Velocity)).ToQuat());
+				}
+
+				if (bWithGroundSnap && Slot.bSnapToGround)
+				{
+					ChunkSnapInstances[ChunkIndex].Add(InstanceIndex);
+				}
+			}
+
+		}, NumInstance < GSkelot_MinParallelBatchSize ? EParallelForFlags::ForceSingleThread : EParallelForFlags::None);
+
+		TArray<int32> SnapInstances;
+		for (const TArray<int32>& Chunk : ChunkSnapInstances)
+			SnapInstances.Append(Chunk);
+
+		//walked backward so that the last request of an instance wins, its bit is cleared by the first one processed
+		for (int32 AdvanceIndex = PendingVelocityAdvances.Num() - 1; AdvanceIndex >= 0; AdvanceIndex--)
+		{
+			const FPendingVelocityAdvance& Advance = PendingVelocityAdvances[AdvanceIndex];
+			FSkelotInstancesSOA::FSlotData& Slot = SOA.Slots[Advance.InstanceIndex];
+			if (Slot.bDestroyed || !Slot.bIntegrateVelocityOnce)
+				continue;
+
+			Slot.bIntegrateVelocityOnce = false;
+
+			FVector3f AppliedVelocity = Advance.DesiredVelocity;
+			if (Advance.bPreferCurrentVelocityForMovement && !SOA.Velocities[Advance.InstanceIndex].IsNearlyZero())
+				AppliedVelocity = SOA.Velocities[Advance.InstanceIndex];
+
+			if (Advance.DeltaTime > 0)
+			{
+				SOA.Locations[Advance.InstanceIndex] += FVector(AppliedVelocity) * Advance.DeltaTime;
+				SOA.MarkTransformDirty(Advance.InstanceIndex);
+			}
+
+			if (Advance.bRotateToMovement && !AppliedVelocity.IsNearlyZero())
+			{
+				SOA.Rotations[Advance.InstanceIndex] = FQuat4f(FRotationMatrix::MakeFromX(FVector(AppliedVelocity)).ToQuat());
+				SOA.MarkTransformDirty(Advance.InstanceIndex);
+			}
+
+			if (bWithGroundSnap && Slot.bSnapToGround)
+				SnapInstances.Add(Advance.InstanceIndex);
+		}
+
+		PendingVelocityAdvances.Reset();
+
+		if (SnapInstances.Num())
+			OnGroundSnap.Execute(this, SnapInstances);
+	}
+
+	/*
+	stale entries stay in the heaps until they reach the top, rebuild the heap if they outnumber the live ones.
+	FindLiveTime returns pointer to the current expiry time of a handle or null if it has none.
+	*/
+	template<typename TFindFunc> static void CompactExpiryHeap(TArray<FSkelotExpiryHeapEntry>& Heap, int32 NumLive, TFindFunc FindLiveTime)
+	{
+		if (Heap.Num() <= NumLive * 2 + 64)
+			return;
+
+		Heap.RemoveAllSwap([&](const FSkelotExpiryHeapEntry& Entry) {
+			const double* LiveTime = FindLiveTime(Entry.Handle);
+			return !LiveTime || *LiveTime != Entry.Time;
+		}, EAllowShrinking::No);
+		Heap.Heapify();
+	}
+	void CompactTimerHeaps()
+	{
+		for (int32 TimeIndex = 0; TimeIndex < UE_ARRAY_COUNT(TimerHeaps); TimeIndex++)
+		{
+			CompactExpiryHeap(TimerHeaps[TimeIndex], TimerMap.Num(), [&](FSkelotInstanceHandle Handle) -> const double* {
+				const FSkelotInstanceTimerData* TimerData = TimerMap.Find(Handle);
+				return (TimerData && TimerData->TimeIndex == TimeIndex) ? &TimerData->FireTime : nullptr;
+			});
+		}
+	}
+
 	void ConsumeRootMotions()
 	{
 		for (int32 InstanceIndex = 0; InstanceIndex < HandleAllocator.GetMaxSize(); InstanceIndex++)
@@ -954,8 +1616,11 @@ public:
 
 			if (SOA.Slots[InstanceIndex].bApplyRootMotion)
 			{
-				SetInstanceTransform(InstanceIndex, FTransform(SOA.RootMotions[InstanceIndex]) * GetInstanceTransform(InstanceIndex));
-				SOA.RootMotions[InstanceIndex] = FTransform3f::Identity;
+				if (FTransform3f* RootMotion = SOA.RootMotions.Find(InstanceIndex))
+				{
+					SetInstanceTransform(InstanceIndex, FTransform(*RootMotion) * GetInstanceTransform(InstanceIndex));
+					*RootMotion = FTransform3f::Identity;
+				}
 			}
 		}
 	}
@@ -1003,36 +1668,24 @@ void ASkelotWorld::Tick(float DeltaSeconds)
 
 	Super::Tick(DeltaSeconds);
 
-	// 更新 LOD 帧计数器和相机位置缓存
-	if (LODConfig.bEnableLODUpdateFrequency)
+	// 空间网格/RVO/PBD：由主分片统一驱动，各分片数据互不相交，可并行执行
+	if (ShardIndex == 0)
 	{
-		LODUpdateFrameCounter++;
-
-		// 获取主相机位置
-		if (UWorld* World = GetWorld())
-		{
-			if (APlayerController* PC = World->GetFirstPlayerController())
-			{
-				if (AActor* ViewTarget = PC->GetViewTarget())
-				{
-					CachedCameraLocation = ViewTarget->GetActorLocation();
-				}
-				else if (PC->PlayerCameraManager)
-				{
-					CachedCameraLocation = PC->PlayerCameraManager->GetCameraLocation();
-				}
-			}
-		}
-	}
+		TArray<ASkelotWorld*, TInlineAllocator<8>> ShardsToTick;
+		if (USkelotWorldSubsystem* SubSys = GetWorld()->GetSubsystem<USkelotWorldSubsystem>())
+			SubSys->ForEachShard([&](ASkelotWorld* Shard) { ShardsToTick.Add(Shard); });
 
-	// 重建空间网格（用于高效的空间查询）
-	RebuildSpatialGrid();
+		if (ShardsToTick.Num() == 0)
+			ShardsToTick.Add(this);
 
-	// 执行RVO避障计算（用于速度修正）
-	ComputeRVOAvoidance(DeltaSeconds);
+		//obstacles are UObjects, only their POD snapshot is used by the parallel part
+		for (ASkelotWorld* Shard : ShardsToTick)
+			Shard->UpdateObstacleDataCache();
 
-	// 执行PBD碰撞求解（用于实例间碰撞避让）
-	SolvePBDCollisions(DeltaSeconds);
+		ParallelFor(ShardsToTick.Num(), [&](int32 Index) {
+			ShardsToTick[Index]->TickSimulation(DeltaSeconds);
+		}, ShardsToTick.Num() == 1 ? EParallelForFlags::ForceSingleThread : EParallelForFlags::None);
+	}
 
 #if UE_ENABLE_DEBUG_DRAWING	//draw phys bounds of instances
 	if(GSkelot_DrawPhyAsset)
@@ -1054,6 +1707,34 @@ void ASkelotWorld::Tick(float DeltaSeconds)
 #endif
 }
 
+void ASkelotWorld::TickSimulation(float DeltaSeconds)
+{
+	// 重建空间网格（用于高效的空间查询）
+	RebuildSpatialGrid();
+
+	const uint64 StartCycles = FPlatformTime::Cycles64();
+
+	// 执行RVO避障计算（用于速度修正）
+	ComputeRVOAvoidance(DeltaSeconds);
+
+	// 执行PBD碰撞求解（用于实例间碰撞避让）
+	SolvePBDCollisions(DeltaSeconds);
+
+	// 计入重要度预算的实测耗时
+	if (SignificanceConfig.bEnableSignificance)
+		SignificanceMeasuredCycles += FPlatformTime::Cycles64() - StartCycles;
+}
+
+void ASkelotWorld::SetShardIndex(uint32 InShardIndex)
+{
+	check(InShardIndex < FSkelotInstanceHandle::MaxShards);
+	check(GetNumValidInstance() == 0);
+
+	ShardIndex = InShardIndex;
+	for (FSkelotInstancesSOA::FSlotData& Slot : SOA.Slots)
+		Slot.Version = (Slot.Version & FSkelotInstanceHandle::SerialMask) | (ShardIndex << FSkelotInstanceHandle::ShardShift);
+}
+
 void ASkelotWorld::BeginDestroy()
 {
 	Super::BeginDestroy();
@@ -1093,6 +1774,13 @@ void ASkelotWorld::EndPlay(EEndPlayReason::Type Reason)
 
 	this->RenderDescs.Empty();
 	this->InstancesNeedCluster.Empty();
+	this->GroupMembers.Empty();
+
+	for (const TWeakObjectPtr<USkelotInstanceComponent>& WeakComponent : DirtyInstanceComponents)
+		if (USkelotInstanceComponent* Component = WeakComponent.Get())
+			Component->bTransformSyncPending = false;
+
+	DirtyInstanceComponents.Empty();
 }
 
 void ASkelotWorld::Destroyed()
@@ -1130,84 +1818,76 @@ FSkelotInstanceHandle ASkelotWorld::CreateInstance(const FTransform& Transform,
 		Impl()->IncreaseSOAs();
 	}
 
-	uint32 OldVersion = SOA.Slots[InstanceIdx].Version;
-	//reset to default but keep version
-	SOA.Slots[InstanceIdx] = FSkelotInstancesSOA::FSlotData();
-	SOA.Slots[InstanceIdx].Version = OldVersion;
-
-	SOA.ClusterData[InstanceIdx].ClusterIdx = -1;
-	SOA.ClusterData[InstanceIdx].DescIdx = DescId.AsInteger();
-	SOA.ClusterData[InstanceIdx].RenderIdx = -1;
-
-	//lets attach default submeshes 
-	uint8* SMIIter = GetInstanceSubmeshIndices(InstanceIdx);
-	const uint8* SMIEnd = SMIIter + this->MaxSubmeshPerInstance;
 	const FSkelotInstanceRenderDescFinal& CurDesc = RenderDescs.Get(DescId);
-	checkf(CurDesc.Meshes.Num() < 255, TEXT("at most 254 sub mesh are supported."));
-	for (int32 MeshIdx = 0; MeshIdx < CurDesc.Meshes.Num(); MeshIdx++)
-	{
-		if (CurDesc.Meshes[MeshIdx].bAttachByDefault)
-		{
-			*SMIIter = (uint8)MeshIdx;
-			SMIIter++;
-			if (SMIIter == SMIEnd)
-				break;
-		}
-	}
-	*SMIIter = 0xFF;
+	checkf(CurDesc.Meshes.Num() <= FSkelotSubmeshMask::MaxSubmesh, TEXT("at most %d sub mesh are supported."), FSkelotSubmeshMask::MaxSubmesh);
+	Impl()->InitializeInstance(InstanceIdx, Transform, DescId, CurDesc);
 
-	SetInstanceTransform(InstanceIdx, Transform);
-	SOA.PrevLocations[InstanceIdx] = SOA.Locations[InstanceIdx];
-	SOA.PrevRotations[InstanceIdx] = SOA.Rotations[InstanceIdx];
-	SOA.PrevScales[InstanceIdx]	   = SOA.Scales[InstanceIdx];
+	InstancesNeedCluster.Add(InstanceIdx);
+	return FSkelotInstanceHandle{ InstanceIdx, SOA.Slots[InstanceIdx].Version };
+}
 
-	//initialize velocity to zero
-	SOA.Velocities[InstanceIdx] = FVector3f::ZeroVector;
+void ASkelotWorld::CreateInstances(TConstArrayView<FTransform> Transforms, const FSkelotInstanceRenderDesc& Desc, TArray<FSkelotInstanceHandle>& OutHandles, const FSkelotAnimPlayParams* AnimParams)
+{
+	FSetElementId DescId = Impl()->FindOrAddDesc(Desc);
+	CreateInstances(Transforms, DescId, OutHandles, AnimParams);
+}
 
-	//initialize collision channel and mask to defaults
-	//default: Channel0 (value 0), mask 0xFF (collide with all channels)
-	SOA.CollisionChannels[InstanceIdx] = SkelotCollision::DefaultCollisionChannel;
-	SOA.CollisionMasks[InstanceIdx] = SkelotCollision::DefaultCollisionMask;
+void ASkelotWorld::CreateInstances(TConstArrayView<FTransform> Transforms, USkelotRenderParams* RenderParams, TArray<FSkelotInstanceHandle>& OutHandles, const FSkelotAnimPlayParams* AnimParams)
+{
+	OutHandles.Reset();
+	if (!RenderParams)
+		return;
 
-	// 重置 RVO 代理数据，防止复用索引时继承已销毁实例的残留状态
-	RVOSystem.ResetAgentDataForInstance(InstanceIdx);
+	CreateInstances(Transforms, RenderParams->Data, OutHandles, AnimParams);
+}
 
-	SOA.CurAnimFrames[InstanceIdx] = 0;
-	SOA.PreAnimFrames[InstanceIdx] = 0;
-	new (&SOA.AnimDatas[InstanceIdx])  FSkelotInstancesSOA::FAnimData();
-	new (&SOA.MiscData[InstanceIdx]) FSkelotInstancesSOA::FMiscData();
+void ASkelotWorld::CreateInstances(TConstArrayView<FTransform> Transforms, FSetElementId DescId, TArray<FSkelotInstanceHandle>& OutHandles, const FSkelotAnimPlayParams* AnimParams)
+{
+	SKELOT_SCOPE_CYCLE_COUNTER(CreateInstances);
 
-	SOA.UserData[InstanceIdx].Pointer = nullptr;
+	OutHandles.Reset();
+	const int32 NumToCreate = Transforms.Num();
+	if (NumToCreate == 0)
+		return;
 
-	//fill custom data with zero
-	float* CustomData = Impl()->GetInstanceCustomDataFloats(InstanceIdx);
-	for (int32 i = 0; i < SOA.MaxNumCustomDataFloat; i++)
-		CustomData[i] = 0;
+	//allocate all handles as one span so SOA writes are contiguous
+	const int32 BaseIdx = HandleAllocator.Allocate(NumToCreate);
+	if (BaseIdx + NumToCreate > SOA.Slots.Num())
+	{
+		Impl()->IncreaseSOAs(BaseIdx + NumToCreate);
+	}
 
-	SOA.RootMotions[InstanceIdx] = FTransform3f::Identity;
+	const FSkelotInstanceRenderDescFinal& CurDesc = RenderDescs.Get(DescId);
+	checkf(CurDesc.Meshes.Num() <= FSkelotSubmeshMask::MaxSubmesh, TEXT("at most %d sub mesh are supported."), FSkelotSubmeshMask::MaxSubmesh);
 
-	InstancesNeedCluster.Add(InstanceIdx);
-	return FSkelotInstanceHandle{ InstanceIdx, SOA.Slots[InstanceIdx].Version };
-}
+	ParallelFor(NumToCreate, [&](int32 Index) {
+		Impl()->InitializeInstance(BaseIdx + Index, Transforms[Index], DescId, CurDesc);
+	}, NumToCreate < GSkelot_MinParallelBatchSize ? EParallelForFlags::ForceSingleThread : EParallelForFlags::None);
 
-void ASkelotWorld::CreateInstances(const TArray<FTransform>& Transforms, const FSkelotInstanceRenderDesc& Desc, TArray<FSkelotInstanceHandle>& OutHandles)
-{
-	FSetElementId DescId = Impl()->FindOrAddDesc(Desc);
-	OutHandles.Reset();
-	OutHandles.Reserve(Transforms.Num());
-	for (const FTransform& Transform : Transforms)
+	//cluster assignment happens once for the whole batch at end of frame
+	InstancesNeedCluster.Reserve(InstancesNeedCluster.Num() + NumToCreate);
+	OutHandles.SetNumUninitialized(NumToCreate);
+	for (int32 Index = 0; Index < NumToCreate; Index++)
 	{
-		OutHandles.Add(CreateInstance(Transform, DescId));
+		const int32 InstanceIdx = BaseIdx + Index;
+		InstancesNeedCluster.Add(InstanceIdx);
+		OutHandles[Index] = FSkelotInstanceHandle{ InstanceIdx, SOA.Slots[InstanceIdx].Version };
+	}
+
+	//transitions and anim collection data are not thread safe, play serially
+	if (AnimParams && AnimParams->Animation)
+	{
+		for (int32 Index = 0; Index < NumToCreate; Index++)
+			InstancePlayAnimation(BaseIdx + Index, *AnimParams);
 	}
 }
 
-void ASkelotWorld::CreateInstances(const TArray<FTransform>& Transforms, USkelotRenderParams* RenderParams, TArray<FSkelotInstanceHandle>& OutHandles)
+void ASkelotWorld::ReserveInstances(int32 NumInstances)
 {
-	OutHandles.Reset();
-	if (!RenderParams)
-		return;
-
-	CreateInstances(Transforms, RenderParams->Data, OutHandles);
+	if (NumInstances > SOA.Slots.Num())
+	{
+		Impl()->IncreaseSOAs(NumInstances);
+	}
 }
 
 void ASkelotWorld::DestroyInstance(FSkelotInstanceHandle H)
@@ -1241,6 +1921,173 @@ void ASkelotWorld::DestroyInstance(int32 InstanceIndex)
 	}
 }
 
+void ASkelotWorld::DestroyInstances(TConstArrayView<FSkelotInstanceHandle> Handles)
+{
+	SKELOT_SCOPE_CYCLE_COUNTER(DestroyInstances);
+
+	bool bAnyPendingCluster = false;
+	for (FSkelotInstanceHandle H : Handles)
+	{
+		if (!IsHandleValid(H)) //already destroyed by a previous entry (duplicate or child of a destroyed parent) ?
+			continue;
+
+		if (GetInstanceAttachParentData(H.InstanceIndex))
+		{
+			DestroyInstance(H.InstanceIndex);
+		}
+		else
+		{
+			bAnyPendingCluster |= SOA.ClusterData[H.InstanceIndex].ClusterIdx == -1;
+			Impl()->LowLevelDestroyInstance(H.InstanceIndex, false);
+		}
+	}
+
+	if (bAnyPendingCluster)
+	{
+		Impl()->RemoveDestroyedFromPendingClusters();
+	}
+}
+
+//value arrays of the batch functions either match the handles or have one value for all
+static bool SkelotCheckBatchNum(const TCHAR* FuncName, int32 NumHandle, int32 NumValue)
+{
+	if (NumValue == NumHandle || (NumValue == 1 && NumHandle > 0))
+		return true;
+
+	if (NumHandle > 0)
+		UE_LOG(LogSkelot, Warning, TEXT("%s: size mismatch (%d handles vs %d values)"), FuncName, NumHandle, NumValue);
+
+	return false;
+}
+
+static EParallelForFlags SkelotBatchParallelFlags(int32 Num)
+{
+	return Num < GSkelot_MinParallelBatchSize ? EParallelForFlags::ForceSingleThread : EParallelForFlags::None;
+}
+
+void ASkelotWorld::MarkInstanceComponentDirty(USkelotInstanceComponent* Component)
+{
+	check(IsInGameThread());
+	if (!Component->bTransformSyncPending)
+	{
+		Component->bTransformSyncPending = true;
+		DirtyInstanceComponents.Add(Component);
+	}
+}
+
+void ASkelotWorld::SyncInstanceComponentTransforms()
+{
+	if (DirtyInstanceComponents.Num() == 0)
+		return;
+
+	SKELOT_SCOPE_CYCLE_COUNTER(SyncInstanceComponentTransforms);
+
+	//resolve once on game thread, components destroyed or whose instance is gone are dropped
+	TArray<TPair<int32, const USkelotInstanceComponent*>> Targets;
+	Targets.Reserve(DirtyInstanceComponents.Num());
+	for (const TWeakObjectPtr<USkelotInstanceComponent>& WeakComponent : DirtyInstanceComponents)
+	{
+		if (USkelotInstanceComponent* Component = WeakComponent.Get())
+		{
+			Component->bTransformSyncPending = false;
+			if (IsHandleValid(Component->Handle))
+				Targets.Emplace(Component->Handle.InstanceIndex, Component);
+		}
+	}
+	DirtyInstanceComponents.Reset();
+
+	ParallelFor(Targets.Num(), [&](int32 Index) {
+		SetInstanceTransform(Targets[Index].Key, Targets[Index].Value->GetComponentTransform());
+	}, SkelotBatchParallelFlags(Targets.Num()));
+}
+
+void ASkelotWorld::SetInstanceTransforms(TConstArrayView<FSkelotInstanceHandle> Handles, TConstArrayView<FTransform> Transforms)
+{
+	SKELOT_SCOPE_CYCLE_COUNTER(SetInstanceTransforms);
+
+	if (!SkelotCheckBatchNum(TEXT("SetInstanceTransforms"), Handles.Num(), Transforms.Num()))
+		return;
+
+	const bool bBroadcast = Transforms.Num() == 1;
+	ParallelFor(Handles.Num(), [&](int32 Index) {
+		if (IsHandleValid(Handles[Index]))
+			SetInstanceTransform(Handles[Index].InstanceIndex, Transforms[bBroadcast ? 0 : Index]);
+	}, SkelotBatchParallelFlags(Handles.Num()));
+}
+
+void ASkelotWorld::GetInstanceLocations(TConstArrayView<FSkelotInstanceHandle> Handles, TArray<FVector>& OutLocations) const
+{
+	SKELOT_SCOPE_CYCLE_COUNTER(GetInstanceLocations);
+
+	OutLocations.SetNumUninitialized(Handles.Num());
+	ParallelFor(Handles.Num(), [&](int32 Index) {
+		OutLocations[Index] = IsHandleValid(Handles[Index]) ? FVector(SOA.Locations[Handles[Index].InstanceIndex]) : FVector::ZeroVector;
+	}, SkelotBatchParallelFlags(Handles.Num()));
+}
+
+void ASkelotWorld::InstancesPlayAnimation(TConstArrayView<FSkelotInstanceHandle> Handles, TConstArrayView<FSkelotAnimPlayParams> Params)
+{
+	SKELOT_SCOPE_CYCLE_COUNTER(InstancesPlayAnimation);
+
+	if (!SkelotCheckBatchNum(TEXT("InstancesPlayAnimation"), Handles.Num(), Params.Num()))
+		return;
+
+	//not thread safe, transitions may be generated
+	for (int32 Index = 0; Index < Handles.Num(); Index++)
+	{
+		if (IsHandleValid(Handles[Index]))
+			InstancePlayAnimation(Handles[Index].InstanceIndex, Params[Params.Num() == 1 ? 0 : Index]);
+	}
+}
+
+void ASkelotWorld::SetInstancesCustomDataFloat(TConstArrayView<FSkelotInstanceHandle> Handles, TConstArrayView<float> Values, int32 Offset, int32 Count)
+{
+	SKELOT_SCOPE_CYCLE_COUNTER(SetInstancesCustomDataFloat);
+
+	if (Count <= 0 || Values.Num() % Count != 0 || !SkelotCheckBatchNum(TEXT("SetInstancesCustomDataFloat"), Handles.Num(), Values.Num() / Count))
+		return;
+
+	check(Offset >= 0);
+	const int32 NumToWrite = FMath::Min(Count, SOA.MaxNumCustomDataFloat - Offset);
+	if (NumToWrite <= 0)
+		return;
+
+	const bool bBroadcast = Values.Num() == Count;
+	auto WriteInstance = [&](int32 Index) {
+		if (IsHandleValid(Handles[Index]))
+		{
+			float* InstanceFloats = SOA.PerInstanceCustomData.GetMutable(Handles[Index].InstanceIndex);
+			FMemory::Memcpy(InstanceFloats + Offset, Values.GetData() + (bBroadcast ? 0 : Index * Count), NumToWrite * sizeof(float));
+		}
+	};
+
+	//sparse pages are allocated on first write which isn't thread safe
+	if (SOA.PerInstanceCustomData.IsSparse())
+	{
+		for (int32 Index = 0; Index < Handles.Num(); Index++)
+			WriteInstance(Index);
+	}
+	else
+	{
+		ParallelFor(Handles.Num(), WriteInstance, SkelotBatchParallelFlags(Handles.Num()));
+	}
+}
+
+void ASkelotWorld::InstancesAttachMesh(TConstArrayView<FSkelotInstanceHandle> Handles, TConstArrayView<USkeletalMesh*> Meshes, bool bAttach)
+{
+	SKELOT_SCOPE_CYCLE_COUNTER(InstancesAttachMesh);
+
+	if (!SkelotCheckBatchNum(TEXT("InstancesAttachMesh"), Handles.Num(), Meshes.Num()))
+		return;
+
+	//submesh changes flag the cluster of the instance, game thread only
+	for (int32 Index = 0; Index < Handles.Num(); Index++)
+	{
+		if (IsHandleValid(Handles[Index]))
+			InstanceAttachMesh_ByAsset(Handles[Index].InstanceIndex, Meshes[Meshes.Num() == 1 ? 0 : Index], bAttach);
+	}
+}
+
 //////////////////////////////////////////////////////////////////////////
 // Velocity API
 
@@ -1305,62 +2152,23 @@ void ASkelotWorld::AdvanceInstancesByVelocity(const TArray<int32>& InstanceIndic
 			continue;
 		}
 
-		FPendingVelocityAdvance& PendingAdvance = PendingVelocityAdvances.FindOrAdd(InstanceIndex);
-		PendingAdvance.DesiredVelocity = DesiredVelocities[i];
-		PendingAdvance.DeltaTime = DeltaTime;
-		PendingAdvance.bPreferCurrentVelocityForMovement = bPreferCurrentVelocityForMovement;
-		PendingAdvance.bRotateToMovement = bRotateToMovement;
+		SOA.Slots[InstanceIndex].bIntegrateVelocityOnce = true;
+		PendingVelocityAdvances.Add(FPendingVelocityAdvance{ InstanceIndex, DesiredVelocities[i], DeltaTime, bPreferCurrentVelocityForMovement, bRotateToMovement });
 
 		// 立即写入目标速度，确保同帧的 RVO/PBD 求解能读取到最新输入
 		SOA.Velocities[InstanceIndex] = DesiredVelocities[i];
 	}
 }
 
-void ASkelotWorld::ConsumePendingVelocityAdvances()
+void ASkelotWorld::SetInstanceVelocityIntegration(int32 InstanceIndex, bool bEnable, bool bFaceVelocity, bool bSnapToGround)
 {
-	check(IsInGameThread());
-
-	if (PendingVelocityAdvances.Num() == 0)
-	{
-		return;
-	}
-
-	for (const TPair<int32, FPendingVelocityAdvance>& PendingPair : PendingVelocityAdvances)
+	if (IsInstanceAlive(InstanceIndex))
 	{
-		const int32 InstanceIndex = PendingPair.Key;
-		if (!IsInstanceAlive(InstanceIndex))
-		{
-			continue;
-		}
-
-		const FPendingVelocityAdvance& PendingAdvance = PendingPair.Value;
-		FVector3f AppliedVelocity = PendingAdvance.DesiredVelocity;
-		if (PendingAdvance.bPreferCurrentVelocityForMovement)
-		{
-			AppliedVelocity = SOA.Velocities[InstanceIndex];
-			if (AppliedVelocity.IsNearlyZero())
-			{
-				AppliedVelocity = PendingAdvance.DesiredVelocity;
-			}
-		}
-
-		if (PendingAdvance.DeltaTime > 0.0f)
-		{
-			SOA.Locations[InstanceIndex] += FVector(AppliedVelocity) * PendingAdvance.DeltaTime;
-		}
-
-		if (PendingAdvance.bRotateToMovement)
-		{
-			const FVector FacingDirection = FVector(AppliedVelocity).GetSafeNormal();
-			if (!FacingDirection.IsNearlyZero())
-			{
-				const FQuat TargetRotation = FRotationMatrix::MakeFromX(FacingDirection).ToQuat();
-				SOA.Rotations[InstanceIndex] = FQuat4f(TargetRotation);
-			}
-		}
+		FSkelotInstancesSOA::FSlotData& Slot = SOA.Slots[InstanceIndex];
+		Slot.bIntegrateVelocity = bEnable;
+		Slot.bFaceVelocity = bFaceVelocity;
+		Slot.bSnapToGround = bSnapToGround;
 	}
-
-	PendingVelocityAdvances.Reset();
 }
 
 //////////////////////////////////////////////////////////////////////////
@@ -1541,13 +2349,25 @@ bool ASkelotWorld::InstanceAttachMesh_ByIndex_Unsafe(int32 InstanceIndex, uint8
 		SK.bAnyAddRemove = true;
 	}
 
+	FSkelotSubmeshMask& SubmeshMask = GetInstanceSubmeshMask(InstanceIndex);
 	if (bAttach)
 	{
-		return SkelotTerminatedArrayAddUnique(GetInstanceSubmeshIndices(InstanceIndex), MaxSubmeshPerInstance, SubMeshIdx);
+		if (SubmeshMask.IsSet(SubMeshIdx))
+			return true;
+
+		if (SubmeshMask.Num() >= MaxSubmeshPerInstance)
+			return false;
+
+		SubmeshMask.Set(SubMeshIdx);
+		return true;
 	}
 	else
 	{
-		return SkelotTerminatedArrayRemoveShift(GetInstanceSubmeshIndices(InstanceIndex), MaxSubmeshPerInstance, SubMeshIdx);
+		if (!SubmeshMask.IsSet(SubMeshIdx))
+			return false;
+
+		SubmeshMask.Clear(SubMeshIdx);
+		return true;
 	}
 }
 
@@ -1588,9 +2408,7 @@ void ASkelotWorld::InstanceDetachMeshes(int32 InstanceIndex)
 		SK.bAnyAddRemove = true;
 	}
 
-	uint8* SMI = GetInstanceSubmeshIndices(InstanceIndex);
-	for (uint32 i = 0; i < MaxSubmeshPerInstance; i++)
-		SMI[i] = 0xFF;
+	GetInstanceSubmeshMask(InstanceIndex).Reset();
 }
 
 void ASkelotWorld::AttachRandomhMeshByGroup(int32 InstanceIndex, FName GroupName)
@@ -1635,15 +2453,15 @@ void ASkelotWorld::DetachMeshesByGroup(int32 InstanceIndex, FName GroupName)
 	if (SOA.ClusterData[InstanceIndex].DescIdx != -1)
 	{
 		const FSkelotInstanceRenderDesc& Desc = GetInstanceDesc(InstanceIndex);
-		TArray<uint8, TInlineAllocator<64>> ToBeRemoved;
-		for (const uint8* SMIIter = GetInstanceSubmeshIndices(InstanceIndex); *SMIIter != 0xFF; SMIIter++)
-		{
-			if (Desc.Meshes.IsValidIndex(*SMIIter) && Desc.Meshes[*SMIIter].GroupName == GroupName)
-				ToBeRemoved.Add(*SMIIter);
-		}
+		FSkelotSubmeshMask ToBeRemoved;
+		GetInstanceSubmeshMask(InstanceIndex).ForEach([&](uint8 SubMeshIdx) {
+			if (Desc.Meshes.IsValidIndex(SubMeshIdx) && Desc.Meshes[SubMeshIdx].GroupName == GroupName)
+				ToBeRemoved.Set(SubMeshIdx);
+		});
 
-		for (uint8 SubMeshIdx : ToBeRemoved)
+		ToBeRemoved.ForEach([&](uint8 SubMeshIdx) {
 			InstanceAttachMesh_ByIndex_Unsafe(InstanceIndex, SubMeshIdx, false);
+		});
 	}
 }
 
@@ -1652,21 +2470,15 @@ void ASkelotWorld::GetInstanceAttachedMeshes(int32 InstanceIndex, TArray<USkelet
 	if (SOA.ClusterData[InstanceIndex].DescIdx != -1)
 	{
 		const FSkelotInstanceRenderDesc& Desc = GetInstanceDesc(InstanceIndex);
-		for (const uint8* SMIIter = GetInstanceSubmeshIndices(InstanceIndex); *SMIIter != 0xFF; SMIIter++)
-		{
-			OutMeshes.Add(Desc.Meshes[*SMIIter].Mesh);
-		}
+		GetInstanceSubmeshMask(InstanceIndex).ForEach([&](uint8 SubMeshIdx) {
+			OutMeshes.Add(Desc.Meshes[SubMeshIdx].Mesh);
+		});
 	}
 }
 
 bool ASkelotWorld::IsMeshAttached(int32 InstanceIndex, uint8 SubMeshIndex) const
 {
-	check(SubMeshIndex != 0xFF);
-	for (const uint8* Iter = GetInstanceSubmeshIndices(InstanceIndex); *Iter != 0xFF; Iter++)
-		if (*Iter == SubMeshIndex)
-			return true;
-	
-	return false;
+	return SubMeshIndex < FSkelotSubmeshMask::MaxSubmesh && GetInstanceSubmeshMask(InstanceIndex).IsSet(SubMeshIndex);
 }
 
 bool ASkelotWorld::IsMeshAttached(int32 InstanceIndex, FName SubMeshName) const
@@ -1674,8 +2486,9 @@ bool ASkelotWorld::IsMeshAttached(int32 InstanceIndex, FName SubMeshName) const
 	if (SOA.ClusterData[InstanceIndex].DescIdx != -1)
 	{
 		const FSkelotInstanceRenderDesc& Desc = GetInstanceDesc(InstanceIndex);
-		for (const uint8* Iter = GetInstanceSubmeshIndices(InstanceIndex); *Iter != 0xFF; Iter++)
-			if (Desc.Meshes.IsValidIndex(*Iter) && Desc.Meshes[*Iter].Name == SubMeshName)
+		const FSkelotSubmeshMask& SubmeshMask = GetInstanceSubmeshMask(InstanceIndex);
+		for (int32 SubMeshIdx = 0; SubMeshIdx < Desc.Meshes.Num(); SubMeshIdx++)
+			if (Desc.Meshes[SubMeshIdx].Name == SubMeshName && SubmeshMask.IsSet(SubMeshIdx))
 				return true;
 	}
 
@@ -1715,6 +2528,8 @@ float ASkelotWorld::InstancePlayAnimation(int32 InstanceIndex, const FSkelotAnim
 
 	
 	int32 TargetSeqDefIndex = -1; //index for AnimCollection->Sequences[]
+	int32 CompositeDefIndex = -1; //index for AnimCollection->CompositeDefs[]
+	int32 CompositeSegmentIndex = 0;
 	
 
 	const float AssetLength = Params.Animation->GetPlayLength();	//length of the Sequence or Composite (sum of its segments)
@@ -1743,11 +2558,17 @@ float ASkelotWorld::InstancePlayAnimation(int32 InstanceIndex, const FSkelotAnim
 			}
 		}
 #endif
+		CompositeDefIndex = AnimCollection->FindOrAddCompositeDef(CompositeAnimation);
+		if (CompositeDefIndex == -1)
+		{
+			UE_LOGFMT(LogSkelot, Error, "Can't Play {0}. AnimComposite has unregistered segments in {1}", GetDbgFName(Params.Animation), GetDbgFName(AnimCollection));
+			return -1;
+		}
 		//find what segment need to be played
-		const FAnimSegment* AnimSegment = CompositeAnimation->AnimationTrack.GetSegmentAtTime(PlayTrackPos);
-		PlayAnimPos = AnimSegment->ConvertTrackPosToAnimPos(PlayTrackPos);
-		TargetSeqDefIndex = AnimCollection->FindSequenceDef(AnimSegment->GetAnimReference());
-		check(TargetSeqDefIndex != -1);
+		const USkelotAnimCollection::FCompositeDef& CompositeDef = AnimCollection->CompositeDefs[CompositeDefIndex];
+		CompositeSegmentIndex = CompositeDef.FindSegment(PlayTrackPos, 0);
+		PlayAnimPos = CompositeAnimation->AnimationTrack.AnimSegments[CompositeSegmentIndex].ConvertTrackPosToAnimPos(PlayTrackPos);
+		TargetSeqDefIndex = CompositeDef.SegmentSequences[CompositeSegmentIndex];
 	}
 	else if (Params.Animation->GetClass() == UAnimSequence::StaticClass()) // is it UAnimSequence ?
 	{
@@ -1775,6 +2596,9 @@ float ASkelotWorld::InstancePlayAnimation(int32 InstanceIndex, const FSkelotAnim
 	AnimData.AnimationPlayRate = Params.PlayScale;
 	AnimData.AnimationTime = PlayTrackPos;
 	AnimData.CurrentAsset = Params.Animation;
+	AnimData.AnimationCompositeIndex = static_cast<uint16>(CompositeDefIndex);
+	AnimData.AnimationCurrentSegment = static_cast<uint16>(CompositeSegmentIndex);
+	Slot.bNotifyFromRangeStart = true;
 
 	const int32 TargetLocalFrameIndex = static_cast<int32>(PlayAnimPos * TargetSeq.SampleFrequency);
 	const int32 TargetGlobalFrameIndex = TargetSeq.AnimationFrameIndex + TargetLocalFrameIndex;
@@ -1822,7 +2646,8 @@ float ASkelotWorld::InstancePlayAnimation(int32 InstanceIndex, const FSkelotAnim
 
 					AnimData.AnimationCurrentSequence = static_cast<uint16>(TargetSeqDefIndex);
 					AnimData.AnimationTransitionIndex = static_cast<uint16>(TransitionIndex);
-					Impl()->SetAnimFrame(InstanceIndex, Transition.FrameIndex);
+					//newly created transitions are generated in background, keep the current pose until then
+					Impl()->SetAnimFrame(InstanceIndex, Transition.bReady ? Transition.FrameIndex : CurrentSeqStruct.AnimationFrameIndex + CurLocalFrameIndex);
 					return AssetLength;
 				}
 				else
@@ -1949,7 +2774,7 @@ FSkelotAttachParentData* ASkelotWorld::GetInstanceAttachParentData(int32 Instanc
 	if (!IsInstanceAlive(InstanceIndex))
 		return nullptr;
 
-	const int32 AttchIdx = SOA.MiscData[InstanceIndex].AttachmentIndex;
+	const int32 AttchIdx = SOA.MiscData.Get(InstanceIndex).AttachmentIndex;
 	return AttachParentArray.IsValidIndex(AttchIdx) ? const_cast<FSkelotAttachParentData*>(&AttachParentArray[AttchIdx]) : nullptr;
 }
 
@@ -2013,6 +2838,7 @@ FSkelotAttachParentData& ASkelotWorld::Internal_InstanceAttachChild(int32 Parent
 	ChildFrag->Parent = ParentIdx;
 	ChildFrag->Down = ParentFrag->FirstChild;
 	ParentFrag->FirstChild = ChildIdx;
+	bHierarchyOrderDirty = true;
 
 	return *ChildFrag;
 }
@@ -2059,6 +2885,7 @@ void ASkelotWorld::DetachInstanceFromParent(int32 InstanceIdx)
 
 		AttachFrag->Parent = -1;
 		AttachFrag->Down = -1;
+		bHierarchyOrderDirty = true;
 	}
 }
 
@@ -2180,15 +3007,7 @@ void ASkelotWorld::UpdateChildTransforms(int32 InstanceIndex)
 void ASkelotWorld::UpdateChildTransforms(FSkelotAttachParentData& RootFrag)
 {
 	ForEachChild(RootFrag, [&](FSkelotAttachParentData& ParentFrag, FSkelotAttachParentData& ChildFrag) {
-
-		//mul order is == RelT * SocketT * BoneT * ParentInstanceT
-		FTransform3f ChildT = ChildFrag.RelativeTransform;
-		if (ChildFrag.SocketPtr)
-			ChildT *= (FTransform3f)ChildFrag.SocketPtr->GetSocketLocalTransform();
-
-		ChildT *= GetInstanceBoneTransformCS(ParentFrag.InstanceIndex, ChildFrag.SocketBoneIndex);
-
-		SetInstanceTransform(ChildFrag.InstanceIndex, FTransform(ChildT) * GetInstanceTransform(ParentFrag.InstanceIndex));
+		Impl()->UpdateChildTransform(ParentFrag, ChildFrag);
 	});
 }
 FTransform3f ASkelotWorld::GetInstanceBoneTransformCS(int32 InstanceIndex, int32 BoneIndex) const
@@ -2284,29 +3103,113 @@ void ASkelotWorld::DestroyChildren(int32 InstanceIndex)
 		DestroyInstance(H);
 }
 
+static FName SkelotGetAnimEventName(const FSkelotAnimFinishEvent& Event) { return NAME_None; }
+static FName SkelotGetAnimEventName(const FSkelotAnimNotifyEvent& Event) { return Event.NotifyName; }
+
+//groups events by notify name and sequence keeping the order of first occurrence
+template<typename TEvent> static void SkelotGroupAnimEvents(const TArray<TEvent>& Events, TArray<FSkelotAnimEventBatch>& OutBatches)
+{
+	OutBatches.Reset();
+	TMap<TPair<FName, UAnimSequenceBase*>, int32, TInlineSetAllocator<16>> BatchIndices;
+	for (const TEvent& Event : Events)
+	{
+		const FName Name = SkelotGetAnimEventName(Event);
+		int32& BatchIndex = BatchIndices.FindOrAdd(TPair<FName, UAnimSequenceBase*>(Name, Event.AnimSequence), INDEX_NONE);
+		if (BatchIndex == INDEX_NONE)
+		{
+			BatchIndex = OutBatches.AddDefaulted();
+			OutBatches[BatchIndex].NotifyName = Name;
+			OutBatches[BatchIndex].AnimSequence = Event.AnimSequence;
+		}
+		OutBatches[BatchIndex].Handles.Add(Event.Handle);
+	}
+}
+
 void ASkelotWorld::Internal_CallOnAnimationFinished()
 {
 	if (AnimationFinishEvents.Num())
 	{
 		OnAnimationFinished(AnimationFinishEvents);
-		OnAnimationFinishedDelegate.Broadcast(this, AnimationFinishEvents);
+		if (bBroadcastPerEventAnimDelegates)
+			OnAnimationFinishedDelegate.Broadcast(this, AnimationFinishEvents);
+
+		if (OnAnimationFinishedBatchDelegate.IsBound())
+		{
+			SkelotGroupAnimEvents(AnimationFinishEvents, AnimationEventBatches);
+			OnAnimationFinishedBatchDelegate.Broadcast(this, AnimationEventBatches);
+			AnimationEventBatches.Reset();
+		}
+
 		AnimationFinishEvents.Reset();
 	}
 }
 
+void ASkelotWorld::RemapRelocatedTransitionFrames(const USkelotAnimCollection* AnimCollection)
+{
+	check(IsInGameThread());
+
+	bool bUsesCollection = false;
+	for (const FSkelotInstanceRenderDescFinal& Desc : RenderDescs)
+		bUsesCollection |= Desc.AnimCollection == AnimCollection;
+
+	if (!bUsesCollection)
+		return;
+
+	SKELOT_SCOPE_CYCLE_COUNTER(RemapRelocatedTransitionFrames);
+
+	//instances skipped by LOD or significance keep their frame for several frames. previous frames are drawn this frame too
+	const int32 NumInstance = GetNumInstance();
+	const EParallelForFlags ParallelFlags = NumInstance < GSkelot_MinParallelBatchSize ? EParallelForFlags::ForceSingleThread : EParallelForFlags::None;
+	SOA.ParallelForEachAlive(NumInstance, ParallelFlags, [&](int32 InstanceIndex, int32& CurAnimFrame, int32& PreAnimFrame) {
+		if (GetInstanceDesc(InstanceIndex).AnimCollection == AnimCollection)
+		{
+			CurAnimFrame = AnimCollection->RemapRelocatedTransitionFrame(CurAnimFrame);
+			PreAnimFrame = AnimCollection->RemapRelocatedTransitionFrame(PreAnimFrame);
+		}
+	}, SOA.CurAnimFrames, SOA.PreAnimFrames);
+}
+
 void ASkelotWorld::Internal_CallOnAnimationNotify()
 {
 	//name only notifications
 	if (AnimationNotifyEvents.Num())
 	{
 		OnAnimationNotify(AnimationNotifyEvents);
-		OnAnimationNotifyDelegate.Broadcast(this, AnimationNotifyEvents);
+		if (bBroadcastPerEventAnimDelegates)
+			OnAnimationNotifyDelegate.Broadcast(this, AnimationNotifyEvents);
+
+		if (OnAnimationNotifyBatchDelegate.IsBound())
+		{
+			SkelotGroupAnimEvents(AnimationNotifyEvents, AnimationEventBatches);
+			OnAnimationNotifyBatchDelegate.Broadcast(this, AnimationEventBatches);
+			AnimationEventBatches.Reset();
+		}
+
 		AnimationNotifyEvents.Reset();
 	}
 
-	for (const FSkelotAnimNotifyObjectEvent& Ev : AnimationNotifyObjectEvents)
+	//notify objects receive all instances that triggered them with the same sequence in one call, batches go out in the order they were first raised
+	if (AnimationNotifyObjectEvents.Num())
 	{
-		Ev.SkelotNotify->OnNotify(this, Ev.Handle, Ev.AnimSequence);
+		struct FNotifyObjectBatch
+		{
+			ISkelotNotifyInterface* SkelotNotify;
+			UAnimSequenceBase* AnimSequence;
+			TArray<FSkelotInstanceHandle> Handles;
+		};
+		TArray<FNotifyObjectBatch, TInlineAllocator<8>> Batches;
+		TMap<TPair<ISkelotNotifyInterface*, UAnimSequenceBase*>, int32, TInlineSetAllocator<16>> BatchIndices;
+		for (const FSkelotAnimNotifyObjectEvent& Event : AnimationNotifyObjectEvents)
+		{
+			int32& BatchIndex = BatchIndices.FindOrAdd(TPair<ISkelotNotifyInterface*, UAnimSequenceBase*>(Event.SkelotNotify, Event.AnimSequence), INDEX_NONE);
+			if (BatchIndex == INDEX_NONE)
+				BatchIndex = Batches.Add(FNotifyObjectBatch{ Event.SkelotNotify, Event.AnimSequence });
+
+			Batches[BatchIndex].Handles.Add(Event.Handle);
+		}
+
+		for (const FNotifyObjectBatch& Batch : Batches)
+			Batch.SkelotNotify->OnNotifyBatch(this, Batch.AnimSequence, Batch.Handles);
 	}
 
 	AnimationNotifyObjectEvents.Reset();
@@ -2466,16 +3369,13 @@ void ASkelotWorld::RebuildSpatialGrid()
 	{
 		// 使用分帧更新（来自预研文档的 FrameStride 方案）
 		SpatialGrid.RebuildIncremental(SOA, GetNumInstance());
+		return;
 	}
-}
-
-const FSkelotSpatialGrid& ASkelotWorld::GetNeighborQuerySpatialGrid() const
-{
-	check(IsInGameThread());
 
-	if (bEnableSpatialGrid)
+	// 关闭主网格时在求解前构建回退网格；分片可能在工作线程上并行 tick，求解时不能再惰性构建
+	if (!PBDConfig.bEnablePBD && !RVOConfig.bEnableRVO)
 	{
-		return SpatialGrid;
+		return;
 	}
 
 	float DesiredCellSize = TNumericLimits<float>::Max();
@@ -2505,8 +3405,11 @@ const FSkelotSpatialGrid& ASkelotWorld::GetNeighborQuerySpatialGrid() const
 		FallbackSpatialGrid.Rebuild(SOA, GetNumInstance());
 		FallbackSpatialGridFrame = CurrentFrame;
 	}
+}
 
-	return FallbackSpatialGrid;
+const FSkelotSpatialGrid& ASkelotWorld::GetNeighborQuerySpatialGrid() const
+{
+	return bEnableSpatialGrid ? SpatialGrid : FallbackSpatialGrid;
 }
 
 //////////////////////////////////////////////////////////////////////////
@@ -2565,16 +3468,9 @@ void ASkelotWorld::SolvePBDCollisions(float DeltaTime)
 	// 执行PBD碰撞求解（实例间碰撞）
 	PBDCollisionSystem.SolveCollisions(SOA, GetNumInstance(), ActiveSpatialGrid, DeltaTime);
 
-	// 执行障碍物碰撞求解：1次基础 + PostObstacleIterations次额外
-	if (RegisteredObstacles.Num() > 0)
+	// 执行障碍物碰撞求解：1次基础 + PostObstacleIterations次额外（使用 UpdateObstacleDataCache 在游戏线程生成的缓存）
+	if (PBDCollisionSystem.GetNumCachedObstacles() > 0)
 	{
-		// 仅在障碍物数据变化时重建缓存
-		if (bObstaclesDirty)
-		{
-			PBDCollisionSystem.RebuildObstacleDataCache(RegisteredObstacles);
-			bObstaclesDirty = false;
-		}
-
 		PBDCollisionSystem.SolveObstacleCollisions(SOA, GetNumInstance(), DeltaTime);
 
 		for (int32 i = 0; i < PBDConfig.PostObstacleIterations; i++)
@@ -2584,6 +3480,18 @@ void ASkelotWorld::SolvePBDCollisions(float DeltaTime)
 	}
 }
 
+void ASkelotWorld::UpdateObstacleDataCache()
+{
+	check(IsInGameThread());
+
+	// 仅在障碍物数据变化时重建缓存
+	if (bObstaclesDirty)
+	{
+		PBDCollisionSystem.RebuildObstacleDataCache(RegisteredObstacles);
+		bObstaclesDirty = false;
+	}
+}
+
 void ASkelotWorld::SetRVOConfig(const FSkelotRVOConfig& InConfig)
 {
 	RVOConfig = InConfig;
@@ -2638,59 +3546,235 @@ void ASkelotWorld::SetLODConfig(const FSkelotLODConfig& InConfig)
 	LODConfig.FarDistance = FMath::Max(LODConfig.MediumDistance + 100.0f, LODConfig.FarDistance);
 }
 
-bool ASkelotWorld::ShouldUpdateInstanceLOD(int32 InstanceIndex) const
+void ASkelotWorld::SetSignificanceConfig(const FSkelotSignificanceConfig& InConfig)
 {
-	// 如果未启用 LOD 更新频率优化，始终更新
-	if (!LODConfig.bEnableLODUpdateFrequency)
+	SignificanceConfig = InConfig;
+	SignificanceConfig.AnimationMaxTier = FMath::Clamp(SignificanceConfig.AnimationMaxTier, 0, 4);
+	SignificanceConfig.RVOMaxTier = FMath::Clamp(SignificanceConfig.RVOMaxTier, 0, 4);
+	SignificanceConfig.PBDMaxTier = FMath::Clamp(SignificanceConfig.PBDMaxTier, 0, 4);
+
+	// 重新开始估算耗时；关闭时清空更新掩码，所有实例恢复每帧更新
+	SignificanceMeasuredCycles = 0;
+	SignificancePlannedLoad = 0;
+	SignificanceCostPerUpdateMs = 0;
+	if (!SignificanceConfig.bEnableSignificance)
 	{
-		return true;
+		for (TArray<uint64>& Mask : SOA.SignificanceUpdateMasks)
+			Mask.Empty();
+
+		FMemory::Memzero(SOA.SignificanceTiers.GetData(), SOA.SignificanceTiers.Num());
+		FMemory::Memzero(SOA.SignificanceAnimDeltas.GetData(), SOA.SignificanceAnimDeltas.Num() * SOA.SignificanceAnimDeltas.GetTypeSize());
 	}
+}
 
-	// 获取实例的 LOD 级别
-	int32 LODLevel = GetInstanceLODLevel(InstanceIndex);
+void ASkelotWorld::SetInstanceGroup(int32 InstanceIndex, int32 GroupId)
+{
+	if (!IsInstanceAlive(InstanceIndex) || SOA.Groups[InstanceIndex].GroupId == GroupId)
+		return;
 
-	// 根据 LOD 级别决定更新频率
-	switch (LODLevel)
+	Impl()->RemoveInstanceFromGroup(InstanceIndex);
+	if (GroupId != -1)
 	{
-	case 0: // 近距离 - 每帧更新
-		return true;
-	case 1: // 中距离 - 每2帧更新
-		return (LODUpdateFrameCounter % 2) == 0;
-	case 2: // 远距离 - 每4帧更新
-		return (LODUpdateFrameCounter % 4) == 0;
-	default:
-		return true;
+		TArray<int32>& Members = GroupMembers.FindOrAdd(GroupId);
+		SOA.Groups[InstanceIndex].GroupId = GroupId;
+		SOA.Groups[InstanceIndex].MemberIndex = Members.Add(InstanceIndex);
 	}
 }
 
-int32 ASkelotWorld::GetInstanceLODLevel(int32 InstanceIndex) const
+TConstArrayView<int32> ASkelotWorld::GetGroupMembers(int32 GroupId) const
+{
+	const TArray<int32>* Members = GroupMembers.Find(GroupId);
+	return Members ? TConstArrayView<int32>(*Members) : TConstArrayView<int32>();
+}
+
+void ASkelotWorld::ParallelForEachInstanceInFilter(const FSkelotInstanceFilter& Filter, TFunctionRef<void(int32 InstanceIndex)> Proc) const
 {
-	// 获取实例位置
-	if (!SOA.Locations.IsValidIndex(InstanceIndex) || SOA.Slots[InstanceIndex].bDestroyed)
+	if (Filter.GroupId != -1)
 	{
-		return 0; // 默认近距离
+		//members are always alive, only tags need to be checked
+		const TConstArrayView<int32> Members = GetGroupMembers(Filter.GroupId);
+		const EParallelForFlags ParallelFlags = Members.Num() < GSkelot_MinParallelBatchSize ? EParallelForFlags::ForceSingleThread : EParallelForFlags::None;
+		ParallelFor(Members.Num(), [&](int32 MemberIndex) {
+			const int32 InstanceIndex = Members[MemberIndex];
+			if (Filter.MatchTags(SOA.Tags[InstanceIndex]))
+				Proc(InstanceIndex);
+		}, ParallelFlags);
+		return;
+	}
+
+	SOA.ParallelForEachAlive(GetNumInstance(), EParallelForFlags::None, [&](int32 InstanceIndex, const uint64& Tags) {
+		if (Filter.MatchTags(Tags))
+			Proc(InstanceIndex);
+	}, SOA.Tags);
+}
+
+void ASkelotWorld::GatherInstances(const FSkelotInstanceFilter& Filter, TArray<int32>& OutIndices) const
+{
+	SKELOT_SCOPE_CYCLE_COUNTER(GatherInstances);
+
+	OutIndices.Reset();
+
+	if (Filter.GroupId != -1)
+	{
+		for (int32 InstanceIndex : GetGroupMembers(Filter.GroupId))
+			if (Filter.MatchTags(SOA.Tags[InstanceIndex]))
+				OutIndices.Add(InstanceIndex);
+
+		OutIndices.Sort();
+		return;
+	}
+
+	//match in parallel into a bit mask, then extract the indices in order
+	const int32 NumInstance = GetNumInstance();
+	TArray<uint64> MatchMask;
+	MatchMask.SetNumZeroed(FMath::DivideAndRoundUp(NumInstance, 64));
+
+	SOA.ParallelForAliveWords(NumInstance, EParallelForFlags::None, [&](int32 FirstWord, int32 EndWord) {
+		for (int32 WordIndex = FirstWord; WordIndex < EndWord; WordIndex++)
+		{
+			uint64 MatchBits = 0;
+			for (uint64 Word = SOA.AliveMask[WordIndex]; Word; Word &= Word - 1)
+			{
+				const int32 BitIndex = static_cast<int32>(FMath::CountTrailingZeros64(Word));
+				if (WordIndex * 64 + BitIndex >= NumInstance)
+					break;
+
+				if (Filter.MatchTags(SOA.Tags[WordIndex * 64 + BitIndex]))
+					MatchBits |= uint64(1) << BitIndex;
+			}
+			MatchMask[WordIndex] = MatchBits;
+		}
+	});
+
+	int32 NumMatch = 0;
+	for (uint64 Word : MatchMask)
+		NumMatch += static_cast<int32>(FMath::CountBits(Word));
+
+	OutIndices.Reserve(NumMatch);
+	for (int32 WordIndex = 0; WordIndex < MatchMask.Num(); WordIndex++)
+		for (uint64 Word = MatchMask[WordIndex]; Word; Word &= Word - 1)
+			OutIndices.Add(WordIndex * 64 + static_cast<int32>(FMath::CountTrailingZeros64(Word)));
+}
+
+void ASkelotWorld::QueryInstancesByFilter(const FSkelotInstanceFilter& Filter, TArray<FSkelotInstanceHandle>& OutHandles) const
+{
+	TArray<int32> Indices;
+	GatherInstances(Filter, Indices);
+
+	OutHandles.Reset(Indices.Num());
+	for (int32 InstanceIndex : Indices)
+		OutHandles.Add(FSkelotInstanceHandle{ InstanceIndex, SOA.Slots[InstanceIndex].Version });
+}
+
+int32 ASkelotWorld::CountInstancesByFilter(const FSkelotInstanceFilter& Filter) const
+{
+	if (Filter.GroupId != -1 && Filter.RequiredTags == 0 && Filter.ExcludedTags == 0)
+		return GetGroupMembers(Filter.GroupId).Num();
+
+	TArray<int32> Indices;
+	GatherInstances(Filter, Indices);
+	return Indices.Num();
+}
+
+void ASkelotWorld::SetVelocityByFilter(const FSkelotInstanceFilter& Filter, const FVector3f& Velocity)
+{
+	SKELOT_SCOPE_CYCLE_COUNTER(SetVelocityByFilter);
+
+	ParallelForEachInstanceInFilter(Filter, [&](int32 InstanceIndex) {
+		SOA.Velocities[InstanceIndex] = Velocity;
+	});
+}
+
+void ASkelotWorld::SetCustomDataFloatByFilter(const FSkelotInstanceFilter& Filter, const float* Floats, int32 Offset, int32 Count)
+{
+	SKELOT_SCOPE_CYCLE_COUNTER(SetCustomDataFloatByFilter);
+
+	if (Floats == nullptr || Count <= 0)
+		return;
+
+	check(Offset >= 0);
+	const int32 NumToWrite = FMath::Min(Count, SOA.MaxNumCustomDataFloat - Offset);
+	if (NumToWrite <= 0)
+		return;
+
+	//sparse pages are allocated on first write which isn't thread safe
+	if (SOA.PerInstanceCustomData.IsSparse())
+	{
+		TArray<int32> Indices;
+		GatherInstances(Filter, Indices);
+		for (int32 InstanceIndex : Indices)
+			SetInstanceCustomDataFloat(InstanceIndex, Floats, Offset, NumToWrite);
+
+		return;
 	}
 
-	const FVector& InstanceLocation = SOA.Locations[InstanceIndex];
+	ParallelForEachInstanceInFilter(Filter, [&](int32 InstanceIndex) {
+		float* InstanceFloats = SOA.PerInstanceCustomData.Find(InstanceIndex);
+		FMemory::Memcpy(InstanceFloats + Offset, Floats, NumToWrite * sizeof(float));
+	});
+}
+
+int32 ASkelotWorld::PlayAnimationByFilter(const FSkelotInstanceFilter& Filter, const FSkelotAnimPlayParams& Params)
+{
+	SKELOT_SCOPE_CYCLE_COUNTER(PlayAnimationByFilter);
+
+	//playing touches transitions and notify state which are not thread safe
+	TArray<int32> Indices;
+	GatherInstances(Filter, Indices);
+	for (int32 InstanceIndex : Indices)
+		InstancePlayAnimation(InstanceIndex, Params);
+
+	return Indices.Num();
+}
 
-	// 计算到相机的距离
-	float DistanceToCamera = FVector::DistSquared(InstanceLocation, CachedCameraLocation);
-	float MediumDistSq = LODConfig.MediumDistance * LODConfig.MediumDistance;
-	float FarDistSq = LODConfig.FarDistance * LODConfig.FarDistance;
+int32 ASkelotWorld::DestroyInstancesByFilter(const FSkelotInstanceFilter& Filter)
+{
+	TArray<FSkelotInstanceHandle> Handles;
+	QueryInstancesByFilter(Filter, Handles);
+	DestroyInstances(Handles);
+	return Handles.Num();
+}
 
-	// 根据距离确定 LOD 级别
-	if (DistanceToCamera <= MediumDistSq)
+void ASkelotWorld::RegisterViewer(AActor* Viewer)
+{
+	if (Viewer)
 	{
-		return 0; // 近距离
+		ViewerActors.AddUnique(Viewer);
 	}
-	else if (DistanceToCamera <= FarDistSq)
+}
+
+void ASkelotWorld::UnregisterViewer(AActor* Viewer)
+{
+	ViewerActors.RemoveSwap(Viewer);
+}
+
+void ASkelotWorld::SetViewerLocations(const TArray<FVector>& Locations)
+{
+	ViewerLocations = Locations;
+}
+
+bool ASkelotWorld::ShouldUpdateInstanceLOD(int32 InstanceIndex) const
+{
+	// 如果未启用 LOD 更新频率优化，始终更新
+	if (!LODConfig.bEnableLODUpdateFrequency)
 	{
-		return 1; // 中距离
+		return true;
 	}
-	else
+
+	// 近距离每帧、中距离每2帧、远距离每4帧
+	const int32 LODLevel = GetInstanceLODLevel(InstanceIndex);
+	return (LODUpdateFrameCounter & ((1 << LODLevel) - 1)) == 0;
+}
+
+int32 ASkelotWorld::GetInstanceLODLevel(int32 InstanceIndex) const
+{
+	// 级别由 UpdateLODBuckets 每帧预先计算
+	if (!IsInstanceAlive(InstanceIndex))
 	{
-		return 2; // 远距离
+		return 0; // 默认近距离
 	}
+
+	return SOA.LODLevels[InstanceIndex];
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -2818,7 +3902,16 @@ void ASkelotWorld::GetAllHandles(TArray<FSkelotInstanceHandle>& OutHandles)
 
 TObjectPtr<UObject> ASkelotWorld::GetInstanceUserObject(int32 InstanceIndex)
 {
-	return IsInstanceAlive(InstanceIndex) && SOA.UserObjects.IsValidIndex(InstanceIndex) ? SOA.UserObjects[InstanceIndex] : nullptr;
+	if (!IsInstanceAlive(InstanceIndex))
+		return nullptr;
+
+	if (SOA.bSparseUserObjects)
+	{
+		const TObjectPtr<UObject>* ObjPtr = SOA.SparseUserObjects.Find(InstanceIndex);
+		return ObjPtr ? *ObjPtr : nullptr;
+	}
+
+	return SOA.UserObjects.IsValidIndex(InstanceIndex) ? SOA.UserObjects[InstanceIndex] : nullptr;
 }
 
 void ASkelotWorld::SetInstanceUserObject(int32 InstanceIndex, TObjectPtr<UObject> InObject)
@@ -2826,6 +3919,15 @@ void ASkelotWorld::SetInstanceUserObject(int32 InstanceIndex, TObjectPtr<UObject
 	if (!IsInstanceAlive(InstanceIndex))
 		return;
 
+	if (SOA.bSparseUserObjects)
+	{
+		if (InObject)
+			SOA.SparseUserObjects.Add(InstanceIndex, InObject);
+		else
+			SOA.SparseUserObjects.Remove(InstanceIndex);
+		return;
+	}
+
 	if (SOA.UserObjects.Num() < SOA.Slots.Num())
 	{
 		SOA.UserObjects.SetNumZeroed(SOA.Slots.Num());
@@ -2959,8 +4061,6 @@ void ASkelotWorld::LineTraceInstance(int32 InstanceIndex, const FLineTraceParams
 		RP.Length = L;
 		RP.Thickness = T;
 
-		AnimCollection->ConditionalFlushDeferredTransitions(RP.FrameIndex);	//transitions must be ready by now
-
 		for (int32 MeshDefIndex : RenderDesc.CachedMeshDefIndices)
 		{
 			const FSkelotMeshDef& MeshDef = AnimCollection->Meshes[MeshDefIndex];
@@ -3057,8 +4157,6 @@ void ASkelotWorld::DebugDrawCompactPhysicsAsset(int32 InstanceIndex, FColor Colo
 	const FTransform InstanceTransform = GetInstanceTransform(InstanceIndex);
 	check(InstanceTransform.IsValid());
 
-	AnimCollection->ConditionalFlushDeferredTransitions(SOA.CurAnimFrames[InstanceIndex]);	//transitions must be ready by now
-
 	for (int32 MeshDefIndex : RenderDesc.CachedMeshDefIndices)
 	{
 		const FSkelotMeshDef& MeshDef = AnimCollection->Meshes[MeshDefIndex];
@@ -3105,9 +4203,16 @@ void ASkelotWorld::DebugDrawInstanceBound(int32 InstanceIndex, float BoundExtent
 void ASkelotWorld::SetInstancelifespan(FSkelotInstanceHandle H, float Lifespan)
 {
 	if (Lifespan < 0)
+	{
 		LifeSpanMap.Remove(H);
+	}
 	else
-		LifeSpanMap.FindOrAdd(H, GetWorld()->GetTimeSeconds() + Lifespan);
+	{
+		const double DeathTime = GetWorld()->GetTimeSeconds() + Lifespan;
+		LifeSpanMap.Add(H, DeathTime);
+		LifeSpanHeap.HeapPush(FSkelotExpiryHeapEntry{ DeathTime, H });
+		Impl()->CompactExpiryHeap(LifeSpanHeap, LifeSpanMap.Num(), [this](FSkelotInstanceHandle Handle) { return LifeSpanMap.Find(Handle); });
+	}
 }
 
 void ASkelotWorld::ClearInstancelifespan(FSkelotInstanceHandle H)
@@ -3115,20 +4220,105 @@ void ASkelotWorld::ClearInstancelifespan(FSkelotInstanceHandle H)
 	LifeSpanMap.Remove(H);
 }
 
-void ASkelotWorld::TickLifeSpans()
+void ASkelotWorld::SubmitCommandBuffer(FSkelotCommandBuffer&& Buffer)
+{
+	if (!Buffer.IsEmpty())
+		PendingCommandBuffers.Enqueue(MoveTemp(Buffer));
+
+	Buffer.Reset();
+}
+
+void ASkelotWorld::FlushCommandBuffers()
 {
-	for (auto Iter = LifeSpanMap.CreateIterator(); Iter; ++Iter)
+	check(IsInGameThread());
+	SKELOT_SCOPE_CYCLE_COUNTER(FlushCommandBuffers);
+
+	FSkelotCommandBuffer Buffer;
+	TArray<FSkelotInstanceHandle> CreatedHandles;
+	TArray<FSkelotInstanceHandle> BatchHandles;
+	TArray<FTransform> BatchTransforms;
+
+	while (PendingCommandBuffers.Dequeue(Buffer))
 	{
-		if (!IsHandleValid(Iter->Key))
+		//consecutive creates with the same render params go through one CreateInstances batch
+		CreatedHandles.Reset();
+		for (int32 CmdIndex = 0; CmdIndex < Buffer.Creates.Num();)
+		{
+			USkelotRenderParams* RenderParams = Buffer.Creates[CmdIndex].RenderParams;
+			BatchTransforms.Reset();
+			int32 EndIndex = CmdIndex;
+			for (; EndIndex < Buffer.Creates.Num() && Buffer.Creates[EndIndex].RenderParams == RenderParams; EndIndex++)
+				BatchTransforms.Add(Buffer.Creates[EndIndex].Transform);
+
+			CreateInstances(BatchTransforms, RenderParams, BatchHandles);
+			BatchHandles.SetNumZeroed(BatchTransforms.Num()); //invalid handles if creation failed
+
+			for (int32 Index = 0; Index < BatchHandles.Num(); Index++)
+			{
+				const int32 AnimIndex = Buffer.Creates[CmdIndex + Index].AnimIndex;
+				if (AnimIndex != -1 && BatchHandles[Index].IsValid())
+					InstancePlayAnimation(BatchHandles[Index].InstanceIndex, Buffer.CreateAnimParams[AnimIndex]);
+			}
+
+			CreatedHandles.Append(BatchHandles);
+			CmdIndex = EndIndex;
+		}
+
+		for (const TPair<FSkelotInstanceHandle, FTransform>& Cmd : Buffer.Transforms)
+		{
+			if (IsHandleValid(Cmd.Key))
+				SetInstanceTransform(Cmd.Key.InstanceIndex, Cmd.Value);
+		}
+
+		for (const TPair<FSkelotInstanceHandle, FVector3f>& Cmd : Buffer.Velocities)
+		{
+			SetInstanceVelocity(Cmd.Key, Cmd.Value);
+		}
+
+		for (const FSkelotCommandBuffer::FAnimCmd& Cmd : Buffer.Animations)
 		{
-			Iter.RemoveCurrent();
+			if (IsHandleValid(Cmd.Handle))
+				InstancePlayAnimation(Cmd.Handle.InstanceIndex, Cmd.Params);
 		}
-		else if (GetWorld()->GetTimeSeconds() >= Iter->Value)
+
+		for (const FSkelotCommandBuffer::FAttachMeshCmd& Cmd : Buffer.MeshAttachments)
 		{
-			DestroyInstance(Iter->Key);
-			Iter.RemoveCurrent();
+			if (IsHandleValid(Cmd.Handle))
+				InstanceAttachMesh_ByAsset(Cmd.Handle.InstanceIndex, Cmd.Mesh, Cmd.bAttach);
 		}
+
+		DestroyInstances(Buffer.Destroys);
+
+		if (Buffer.OnInstancesCreated)
+			Buffer.OnInstancesCreated(CreatedHandles);
+	}
+}
+
+void ASkelotWorld::TickLifeSpans()
+{
+	SKELOT_SCOPE_CYCLE_COUNTER(TickLifeSpans);
+
+	const double CurTime = GetWorld()->GetTimeSeconds();
+	TArray<FSkelotInstanceHandle, TInlineAllocator<64>> ExpiredHandles;
+
+	while (LifeSpanHeap.Num() && LifeSpanHeap.HeapTop().Time <= CurTime)
+	{
+		FSkelotExpiryHeapEntry Entry;
+		LifeSpanHeap.HeapPop(Entry, EAllowShrinking::No);
+
+		const double* DeathTime = LifeSpanMap.Find(Entry.Handle);
+		if (!DeathTime || *DeathTime != Entry.Time) //cleared or changed since pushed ?
+			continue;
+
+		LifeSpanMap.Remove(Entry.Handle);
+		ExpiredHandles.Add(Entry.Handle);
 	}
+
+	//handles whose instance is already destroyed are skipped by the batch
+	DestroyInstances(ExpiredHandles);
+
+	//entries of destroyed instances are stale now, don't let them pile up until their time comes
+	Impl()->CompactExpiryHeap(LifeSpanHeap, LifeSpanMap.Num(), [this](FSkelotInstanceHandle Handle) { return LifeSpanMap.Find(Handle); });
 }
 
 FSkelotInstanceTimerData* ASkelotWorld::Internal_SetInstanceTimer(FSkelotInstanceHandle H, float Interval, bool bLoop, bool bGameTime)
@@ -3140,6 +4330,9 @@ FSkelotInstanceTimerData* ASkelotWorld::Internal_SetInstanceTimer(FSkelotInstanc
 		TimerData.Interval = Interval;
 		TimerData.TimeIndex = bGameTime ? 1 : 0;
 		TimerData.FireTime = (bGameTime ? GetWorld()->GetTimeSeconds() : GetWorld()->GetRealTimeSeconds()) + Interval;
+
+		TimerHeaps[TimerData.TimeIndex].HeapPush(FSkelotExpiryHeapEntry{ TimerData.FireTime, H });
+		Impl()->CompactTimerHeaps();
 		return &TimerData;
 	}
 	else
@@ -3167,36 +4360,55 @@ void ASkelotWorld::SetInstanceTimer(FSkelotInstanceHandle H, float Interval, boo
 
 void ASkelotWorld::TickTimers()
 {
+	SKELOT_SCOPE_CYCLE_COUNTER(TickTimers);
+
 	TArray<TPair<FSkelotInstanceHandle, FSkelotInstanceGeneralDelegate>, TInlineAllocator<64>> Calls;
 
 	const double CurTimes[] = { GetWorld()->GetRealTimeSeconds(), GetWorld()->GetTimeSeconds() };
+	//looping timers are pushed back after the heap is drained so that each fires at most once per frame, even if its next time is already due
+	TArray<FSkelotExpiryHeapEntry, TInlineAllocator<64>> LoopEntries;
 
-	for (auto Iter = TimerMap.CreateIterator(); Iter; ++Iter)
+	for (int32 TimeIndex = 0; TimeIndex < UE_ARRAY_COUNT(TimerHeaps); TimeIndex++)
 	{
-		auto CurTime = CurTimes[Iter->Value.TimeIndex];
+		TArray<FSkelotExpiryHeapEntry>& Heap = TimerHeaps[TimeIndex];
+		const double CurTime = CurTimes[TimeIndex];
+		LoopEntries.Reset();
 
-		if (!IsHandleValid(Iter->Key))
-		{
-			Iter.RemoveCurrent();
-		}
-		else if (CurTime >= Iter->Value.FireTime)
+		while (Heap.Num() && Heap.HeapTop().Time <= CurTime)
 		{
-			Calls.Add(MakeTuple(Iter->Key, MoveTemp(Iter->Value.Data)));
+			FSkelotExpiryHeapEntry Entry;
+			Heap.HeapPop(Entry, EAllowShrinking::No);
 
-			if (!Iter->Value.bLoop)
+			FSkelotInstanceTimerData* TimerData = TimerMap.Find(Entry.Handle);
+			if (!TimerData || TimerData->TimeIndex != TimeIndex || TimerData->FireTime != Entry.Time) //cleared or changed since pushed ?
+				continue;
+
+			if (!IsHandleValid(Entry.Handle))
+			{
+				TimerMap.Remove(Entry.Handle);
+			}
+			else if (!TimerData->bLoop)
 			{
-				Iter.RemoveCurrent();
+				Calls.Add(MakeTuple(Entry.Handle, MoveTemp(TimerData->Data)));
+				TimerMap.Remove(Entry.Handle);
 			}
 			else
 			{
+				Calls.Add(MakeTuple(Entry.Handle, TimerData->Data));
+
 				//set next invoke time
-				auto Exceed = CurTime - Iter->Value.FireTime;
-				Iter->Value.FireTime = CurTime + Iter->Value.Interval - Exceed;
+				auto Exceed = CurTime - TimerData->FireTime;
+				TimerData->FireTime = CurTime + TimerData->Interval - Exceed;
+				LoopEntries.Add(FSkelotExpiryHeapEntry{ TimerData->FireTime, Entry.Handle });
 			}
-
 		}
+
+		for (const FSkelotExpiryHeapEntry& Entry : LoopEntries)
+			Heap.HeapPush(Entry);
 	}
 
+	Impl()->CompactTimerHeaps();
+
 	for (auto Elem : Calls)
 	{
 		if (FSkelotGeneralDynamicDelegate* DynDlg = Elem.Value.Delegate.TryGet<FSkelotGeneralDynamicDelegate>()) //is it dynamic delegate ?
@@ -3256,6 +4468,11 @@ ASkelotWorld* ASkelotWorld::Get(const UWorld* World, bool bCreateIfNotFound /*=
 	return USkelotWorldSubsystem::Internal_GetSingleton(World, bCreateIfNotFound);
 }
 
+ASkelotWorld* ASkelotWorld::Get(const UObject* Context, FSkelotInstanceHandle Handle)
+{
+	return USkelotWorldSubsystem::GetShard(Context, Handle.GetShardIndex(), Handle.GetShardIndex() == 0);
+}
+
 ASkelotWorld::ASkelotWorld(const FObjectInitializer& ObjectInitializer) :
 	Super(ObjectInitializer),
 	HandleAllocator(true),
@@ -3276,6 +4493,11 @@ ASkelotWorld::ASkelotWorld(const FObjectInitializer& ObjectInitializer) :
 		MaxSubmeshPerInstance = Settings->MaxSubmeshPerInstance;
 		ClusterMode = Settings->ClusterMode;
 
+		SOA.RootMotions.Init(Settings->bSparseRootMotions, FTransform3f::Identity);
+		SOA.MiscData.Init(Settings->bSparseMiscData, FSkelotInstancesSOA::FMiscData());
+		SOA.PerInstanceCustomData.Init(Settings->bSparseCustomData, 0.0f, 0);
+		SOA.bSparseUserObjects = Settings->bSparseUserObjects;
+
 		Impl()->IncreaseSOAs();
 	}
 }
@@ -3291,7 +4513,7 @@ void Skelot_OnWorldPreSendAllEndOfFrameUpdates(UWorld* InWorld)
 	USkelotWorldSubsystem* SubSys = InWorld->GetSubsystem<USkelotWorldSubsystem>();
 	if (SubSys && SubSys->PrimaryInstance)
 	{
-		SubSys->PrimaryInstance->PreSendEndOfFrame();
+		SubSys->ForEachShard([&](ASkelotWorld* Shard) { Shard->PreSendEndOfFrame(); });
 	}
 }
 
@@ -3301,7 +4523,7 @@ void Skelot_OnWorldTickStart(UWorld* InWorld, ELevelTick TickType, float DeltaSe
 	USkelotWorldSubsystem* SubSys = InWorld->GetSubsystem<USkelotWorldSubsystem>();
 	if (SubSys && SubSys->PrimaryInstance)
 	{
-		SubSys->PrimaryInstance->OnWorldTickStart(TickType, DeltaSeconds);
+		SubSys->ForEachShard([&](ASkelotWorld* Shard) { Shard->OnWorldTickStart(TickType, DeltaSeconds); });
 	}
 }
 
@@ -3310,7 +4532,7 @@ void Skelot_OnWorldPreActorTick(UWorld* InWorld, ELevelTick TickType, float Delt
 	USkelotWorldSubsystem* SubSys = InWorld->GetSubsystem<USkelotWorldSubsystem>();
 	if (SubSys && SubSys->PrimaryInstance)
 	{
-		SubSys->PrimaryInstance->OnWorldPreActorTick(TickType, DeltaSeconds);
+		SubSys->ForEachShard([&](ASkelotWorld* Shard) { Shard->OnWorldPreActorTick(TickType, DeltaSeconds); });
 
 	}
 }
@@ -3320,7 +4542,7 @@ void Skelot_OnWorldPostActorTick(UWorld* InWorld, ELevelTick TickType, float Del
 	USkelotWorldSubsystem* SubSys = InWorld->GetSubsystem<USkelotWorldSubsystem>();
 	if (SubSys && SubSys->PrimaryInstance)
 	{
-		SubSys->PrimaryInstance->OnWorldPostActorTick(TickType, DeltaSeconds);
+		SubSys->ForEachShard([&](ASkelotWorld* Shard) { Shard->OnWorldPostActorTick(TickType, DeltaSeconds); });
 	}
 }
 
@@ -3330,7 +4552,7 @@ void Skelot_OnWorldTickEnd(UWorld* InWorld, ELevelTick TickType, float DeltaSeco
 	USkelotWorldSubsystem* SubSys = InWorld->GetSubsystem<USkelotWorldSubsystem>();
 	if (SubSys && SubSys->PrimaryInstance)
 	{
-		SubSys->PrimaryInstance->OnWorldTickEnd(TickType, DeltaSeconds);
+		SubSys->ForEachShard([&](ASkelotWorld* Shard) { Shard->OnWorldTickEnd(TickType, DeltaSeconds); });
 	}
 }
 
@@ -3369,7 +4591,14 @@ void ASkelotWorld::OnWorldPreActorTick(ELevelTick TickType, float DeltaSeconds)
 
 	FMemory::Memcpy(SOA.PreAnimFrames.GetData(), SOA.CurAnimFrames.GetData(), SOA.CurAnimFrames.GetTypeSize() * GetNumInstance());
 
+	Impl()->UpdateSignificance();
+	Impl()->UpdateLODBuckets();
+
+	const uint64 AnimStartCycles = FPlatformTime::Cycles64();
 	Impl()->UpdateAnimations(DeltaSeconds);
+	if (SignificanceConfig.bEnableSignificance)
+		SignificanceMeasuredCycles += FPlatformTime::Cycles64() - AnimStartCycles;
+
 	Impl()->TickTimers();
 	Impl()->ConsumeRootMotions();
 
@@ -3385,14 +4614,24 @@ void ASkelotWorld::OnWorldPostActorTick(ELevelTick TickType, float DeltaSeconds)
 
 	GSkelot_InvClusterCellSize = GSkelot_ClusterCellSize > 0 ? (1.0f / GSkelot_ClusterCellSize) : 0;
 
-	ConsumePendingVelocityAdvances();
+	FlushCommandBuffers();
+	SyncInstanceComponentTransforms();
+
+	Impl()->IntegrateVelocities(DeltaSeconds);
 	TickLifeSpans();
 
 	Impl()->UpdateHierarchyTransforms(DeltaSeconds);
-	Impl()->CalculateBounds(DeltaSeconds);
 	Impl()->UpdateDeterminant(DeltaSeconds);
 	Impl()->UpdateClusters();
+	Impl()->CalculateBounds(DeltaSeconds);
 	Impl()->UpdateFlush(DeltaSeconds);
+
+	if (bPublishInstanceSnapshot)
+		InstanceSnapshot.Publish(SOA, GetNumInstance());
+
+	//transform journal of this frame is consumed, transforms copied from tied components below are picked up next frame
+	FMemory::Memzero(SOA.TransformDirtyMask.GetData(), SOA.TransformDirtyMask.Num() * SOA.TransformDirtyMask.GetTypeSize());
+
 	Impl()->FillDynamicPoseFromComponents();
 }
 
@@ -3,6 +3,8 @@
 #include "SkelotWorldBase.h"
 
 #include "SkelotPrivateUtils.h"
+#include "SkelotPrivate.h"
+#include "Async/TaskGraphInterfaces.h"
 
 
 FString FSkelotInstanceHandle::ToDebugString() const
@@ -15,3 +17,23 @@ FString FSkelotInstanceHandle::ToDebugString() const
 }
 
 
+void FSkelotInstancesSOA::ParallelForAliveWords(int32 NumInstance, EParallelForFlags Flags, TFunctionRef<void(int32 FirstWord, int32 EndWord)> Proc) const
+{
+	const int32 NumWord = FMath::DivideAndRoundUp(NumInstance, 64);
+	if (NumWord == 0)
+		return;
+
+	if (NumInstance < GSkelot_MinParallelBatchSize)
+		Flags |= EParallelForFlags::ForceSingleThread;
+
+	//few ranges per worker for load balancing (dead words are nearly free, alive ones are not), but never less than 256 slots per range
+	constexpr int32 MinWordsPerRange = 4;
+	const int32 NumWorkers = FMath::Max(1, FTaskGraphInterface::Get().GetNumWorkerThreads());
+	const int32 NumRange = EnumHasAnyFlags(Flags, EParallelForFlags::ForceSingleThread) ? 1 : FMath::Clamp(NumWord / MinWordsPerRange, 1, NumWorkers * 4);
+	const int32 WordsPerRange = FMath::DivideAndRoundUp(NumWord, NumRange);
+
+	ParallelFor(NumRange, [&](int32 RangeIndex) {
+		const int32 FirstWord = RangeIndex * WordsPerRange;
+		Proc(FirstWord, FMath::Min(FirstWord + WordsPerRange, NumWord));
+	}, Flags);
+}
@@ -14,11 +14,14 @@
 #include "UnifiedBuffer.h"
 #include "AssetRegistry/AssetData.h"
 #include "SpanAllocator.h"
+#include "Algo/BinarySearch.h"
+#include "Tasks/Task.h"
 
 
 #include "SkelotAnimCollection.generated.h"
 
 class UAnimSequenceBase;
+class UAnimComposite;
 class USkelotAnimCollection;
 class USkeletalMesh;
 class USkeleton;
@@ -52,6 +55,28 @@ struct SKELOT_API FSkelotAnimNotifyDesc
 	UAnimNotify* Notify = nullptr;
 	//
 	ISkelotNotifyInterface* NotifyInterface = nullptr;
+	//see FAnimNotifyEvent::NotifyTriggerChance
+	UPROPERTY()
+	float TriggerChance = 1;
+};
+
+//notify of a baked sequence keyed by local frame index, see FSkelotSequenceDef::NotifyFrames
+struct FSkelotNotifyFrame
+{
+	//local frame index the notify triggers at
+	int32 Frame = 0;
+	//index for FSkelotSequenceDef.Notifies
+	int32 NotifyIndex = 0;
+	//notify triggers if a 32 bit random number is below this, MAX_uint32 means always (no roll)
+	uint32 ChanceThreshold = MAX_uint32;
+};
+
+//root motion of a baked sequence from its start to a sample time, translation plus yaw in the space of the first frame
+struct FSkelotRootMotionSample
+{
+	FVector3f Translation = FVector3f::ZeroVector;
+	//radians, unwound so that it can be interpolated
+	float Yaw = 0;
 };
 
 // Skelot动画序列定义
@@ -75,6 +100,10 @@ struct SKELOT_API FSkelotSequenceDef
 	//we cant use engine notifications (UAnimNotify_PlaySound, etc) so we to have our own classes + its faster :|
 	UPROPERTY(Transient)
 	TArray<FSkelotAnimNotifyDesc> Notifies;
+	//Notifies sorted by the baked frame they trigger at, so that playback only compares frame indices
+	TArray<FSkelotNotifyFrame> NotifyFrames;
+	//one sample per baked frame plus one at the end of the sequence, empty if the sequence has no root motion
+	TArray<FSkelotRootMotionSample> RootMotionTrack;
 
 
 	FSkelotSequenceDef();
@@ -85,6 +114,20 @@ struct SKELOT_API FSkelotSequenceDef
 	float GetSequenceLength() const;
 	//
 	int CalcFrameCount() const;
+	//fills NotifyFrames from Notifies
+	void BuildNotifyFrames();
+	//samples RootMotionTrack, thread safe
+	void BuildRootMotionTrack();
+	//interpolated root motion accumulated from the start of the sequence to Time. RootMotionTrack must not be empty
+	FSkelotRootMotionSample EvaluateRootMotion(float Time) const;
+	//root motion of the range [StartTime, StartTime + DeltaTime] from the baked track, wraps around if bLooping. see UAnimSequenceBase::ExtractRootMotion
+	FTransform3f ExtractBakedRootMotion(float StartTime, float DeltaTime, bool bLooping) const;
+	//calls Proc(const FSkelotNotifyFrame&) for the notifies whose frame is in (AfterFrame, UpToFrame]. AfterFrame may be -1
+	template<typename TProc> void ForEachNotifyInFrameRange(int32 AfterFrame, int32 UpToFrame, TProc Proc) const
+	{
+		for (int32 Index = Algo::UpperBoundBy(NotifyFrames, AfterFrame, &FSkelotNotifyFrame::Frame); Index < NotifyFrames.Num() && NotifyFrames[Index].Frame <= UpToFrame; Index++)
+			Proc(NotifyFrames[Index]);
+	}
 
 };
 
@@ -198,6 +241,38 @@ struct SKELOT_API FSkelotMeshDef
 };
 
 
+// 过渡姿势池统计
+USTRUCT(BlueprintType)
+struct SKELOT_API FSkelotTransitionPoolStats
+{
+	GENERATED_USTRUCT_BODY()
+
+	//number of transitions in the pool, including the unused ones kept in cache
+	UPROPERTY(BlueprintReadOnly, Category = "Skelot|动画集合")
+	int32 NumTransition = 0;
+	//frames allocated by transitions
+	UPROPERTY(BlueprintReadOnly, Category = "Skelot|动画集合")
+	int32 NumFrameAllocated = 0;
+	//end of the highest allocated range
+	UPROPERTY(BlueprintReadOnly, Category = "Skelot|动画集合")
+	int32 HighWater = 0;
+	//MaxTransitionPose
+	UPROPERTY(BlueprintReadOnly, Category = "Skelot|动画集合")
+	int32 Capacity = 0;
+	//NumFrameAllocated / Capacity
+	UPROPERTY(BlueprintReadOnly, Category = "Skelot|动画集合")
+	float Occupancy = 0;
+	//ratio of free frames below HighWater, 0 if the pool is compact
+	UPROPERTY(BlueprintReadOnly, Category = "Skelot|动画集合")
+	float Fragmentation = 0;
+	//total number of transitions moved by defragmentation
+	UPROPERTY(BlueprintReadOnly, Category = "Skelot|动画集合")
+	int32 NumRelocated = 0;
+	//total number of transitions that couldn't be created because the pool was full
+	UPROPERTY(BlueprintReadOnly, Category = "Skelot|动画集合")
+	int32 NumAllocationFailed = 0;
+};
+
 /*
 * data asset that generates and keeps animation data. typically you need one per skeleton.
 * #Note: animation sequences are generated at load time.
@@ -260,10 +335,10 @@ public:
 		int RefCount = 1;
 		uint32 BlockOffset = 0; //offset of block inside TransitionPoseAllocator
 		int FrameIndex = 0; //animation buffer frame index
-		uint16 DeferredIndex = 0xFFff; //index in DeferredTransitions
 		uint16 StateIndex = 0xFFff; //index in ZeroRCTransitions or NegativeRCTransitions depending on RefCount
+		bool bReady = false; //poses are generated and queued for upload. instances play the source pose until then
 
-		bool IsDeferred() const { return DeferredIndex != 0xFFff; }
+		bool IsDeferred() const { return !bReady; }
 		//true if transition has no references and passed one more frame 
 		bool IsUnused() const { return RefCount == -1; }
 	};
@@ -332,6 +407,11 @@ public:
 	//number of animation frames to be reserved for transitions. Transitions are generated and stored when requested.
 	UPROPERTY(EditAnywhere, Category = "动画", meta = (DisplayName = "最大过渡姿势数"))
 	int MaxTransitionPose = 2000;
+	//true if transitions should be generated by blending the baked poses instead of decompressing the animations.
+	//keeps a CPU copy of the whole animation buffer (see TotalAnimationBufferSize) and of the curve buffer, so memory cost equals their VRAM size.
+	//transitions between sequences of different sample frequency are still generated at runtime
+	UPROPERTY(EditAnywhere, Category = "动画", meta = (DisplayName = "混合烘焙姿势生成过渡"))
+	bool bBlendBakedTransitions = false;
 	//number of animation frames to be reserved for dynamic instances
 	UPROPERTY(EditAnywhere, Category = "动画", meta = (DisplayName = "最大动态姿势数"))
 	int MaxDynamicPose;
@@ -346,6 +426,12 @@ public:
 	FGuid LastEditId;
 	UPROPERTY(VisibleAnywhere, Transient, Category = "信息", meta = (DisplayName = "已分配过渡帧数"))
 	int NumTransitionFrameAllocated;
+	//total number of transitions moved by DefragTransitionPool
+	UPROPERTY(VisibleAnywhere, Transient, Category = "信息", meta = (DisplayName = "已重定位过渡数"))
+	int NumTransitionRelocated;
+	//total number of transitions that failed because the pool was full
+	UPROPERTY(VisibleAnywhere, Transient, Category = "信息", meta = (DisplayName = "过渡分配失败数"))
+	int NumTransitionAllocFailed;
 
 	//
 	//
@@ -379,10 +465,63 @@ public:
 	FSpanAllocator TransitionPoseAllocator;
 	TArray<SkelotTransitionIndex> ZeroRCTransitions;
 	TArray<SkelotTransitionIndex> NegativeRCTransitions;
-	//indices of transitions created this frame. will be generated concurrently at EndOfFrame 
+	//indices of transitions waiting for generation, oldest first. generated by a background task that may span several frames
 	TArray<SkelotTransitionIndex> DeferredTransitions;
 	uint32 DeferredTransitions_FrameCount;
 
+	struct FTransitionGenerationJob
+	{
+		FTransition Transition; //copy so that the task doesn't touch Transitions
+		SkelotTransitionIndex TransitionIndex;
+		int ScatterIdx; //index in FTransitionGeneration::UploadData
+		bool bDone;
+	};
+	//transitions handed to the background task, owned by the task until it completes
+	struct FTransitionGeneration
+	{
+		TArray<FTransitionGenerationJob> Jobs;
+		FPoseUploadData UploadData;
+		UE::Tasks::FTask Task;
+	};
+	FTransitionGeneration TransitionGeneration;
+
+	struct FTransitionRelocation
+	{
+		int32 OldFrameIndex;
+		int32 NewFrameIndex;
+		int32 FrameCount;
+	};
+	//transitions moved by the last defragmentation pass. every ASkelotWorld remaps its instances right after the moves,
+	//the old ranges stay allocated until the next pass because render data sent earlier in that frame may still draw them
+	TArray<FTransitionRelocation> TransitionRelocations;
+	//GFrameCounter of the last pass, it runs once per frame
+	uint64 TransitionRelocationFrame = 0;
+
+	//segment layout of an UAnimComposite, cached when first played so that playback doesn't walk the track
+	struct FCompositeDef
+	{
+		//defs are dropped on rebuild, instances compare this to validate the index they cached
+		const UAnimComposite* Composite = nullptr;
+		//track position each segment starts at, ascending
+		TArray<float> SegmentStartTimes;
+		//index for Sequences[] of each segment
+		TArray<uint16> SegmentSequences;
+
+		//returns the segment that contains TrackPos. searches forward from CurSegment and restarts from the first segment if the track wrapped
+		int32 FindSegment(float TrackPos, int32 CurSegment) const
+		{
+			if (TrackPos < SegmentStartTimes[CurSegment])
+				CurSegment = 0;
+			while (CurSegment + 1 < SegmentStartTimes.Num() && TrackPos >= SegmentStartTimes[CurSegment + 1])
+				CurSegment++;
+
+			return CurSegment;
+		}
+	};
+
+	TArray<FCompositeDef> CompositeDefs;
+	TMap<TObjectKey<UAnimComposite>, int32> CompositeDefMap;
+
 	FSpanAllocator DynamicPoseAllocator;
 	TBitArray<> DynamicPoseFlipFlags;
 
@@ -488,6 +627,8 @@ public:
 	void InternalBuildAll();
 
 	int FindSequenceDef(const UAnimSequenceBase* animation) const;
+	//returns index for CompositeDefs[], -1 if any segment is not registered. game thread only
+	int32 FindOrAddCompositeDef(const UAnimComposite* Composite);
 	int FindSequenceDefByPath(const FSoftObjectPath& AnimationPath) const;
 	int FindMeshDef(const USkeletalMesh* Mesh) const;
 	int FindMeshDefByPath(const FSoftObjectPath& MeshPath) const;
@@ -546,17 +687,37 @@ public:
 	//
 	void ReleasePendingTransitions();
 	//
-	void GenerateTransition_Concurrent(uint32 TransitionIndex, uint32 ScatterIdx);
-	//
+	void GenerateTransition_Concurrent(const FTransition& Trs, FPoseUploadData& UploadData, uint32 ScatterIdx);
+	//true if the transition can be generated from the baked poses in memory
+	bool CanBlendBakedTransition(const FTransition& Trs) const;
+	//fast path of GenerateTransition_Concurrent, blends the baked frames bone by bone in local space
+	void BlendBakedTransition_Concurrent(const FTransition& Trs, FPoseUploadData& UploadData, uint32 ScatterIdx);
+	//generates all the deferred transitions now, waits for the background task if any
 	void FlushDeferredTransitions();
-	//
-	bool HasAnyDeferredTransitions() const { return this->DeferredTransitions.Num() > 0; }
-	//flush transitions if FrameIndex is in transition range 
-	void ConditionalFlushDeferredTransitions(int FrameIndex) 
+	//hands deferred transitions to a background task that stops after skelot.TransitionGenerationBudgetMS. does nothing if the previous one is still running
+	void LaunchTransitionGeneration();
+	//collects the poses of the background task and marks its transitions ready, unfinished ones are deferred again. returns false if the task is still running and !bWait
+	bool CompleteTransitionGeneration(bool bWait);
+	//moves transitions from the end of the pool into lower free ranges, up to skelot.TransitionDefragMaxMoves per frame. moved poses are regenerated and uploaded
+	void DefragTransitionPool();
+	//returns FrameIndex relocated by the last defragmentation pass
+	int32 RemapRelocatedTransitionFrame(int32 FrameIndex) const
 	{
-		if(HasAnyDeferredTransitions() && IsTransitionFrameIndex(FrameIndex))
-			FlushDeferredTransitions();
+		if (IsTransitionFrameIndex(FrameIndex))
+		{
+			for (const FTransitionRelocation& Relocation : TransitionRelocations)
+			{
+				if (FrameIndex >= Relocation.OldFrameIndex && FrameIndex < Relocation.OldFrameIndex + Relocation.FrameCount)
+					return Relocation.NewFrameIndex + (FrameIndex - Relocation.OldFrameIndex);
+			}
+		}
+		return FrameIndex;
 	}
+	//
+	UFUNCTION(BlueprintCallable, Category = "Skelot|动画集合", meta = (DisplayName = "获取过渡姿势池统计"))
+	FSkelotTransitionPoolStats GetTransitionPoolStats() const;
+	//
+	bool HasAnyDeferredTransitions() const { return this->DeferredTransitions.Num() > 0 || this->TransitionGeneration.Jobs.Num() > 0; }
 	bool IsAnimationFrameIndex(int FrameIndex) const	{ return FrameIndex > 0 && FrameIndex < FrameCountSequences; }
 	bool IsTransitionFrameIndex(int FrameIndex) const	{ return FrameIndex >= FrameCountSequences && FrameIndex < (FrameCountSequences + MaxTransitionPose); }
 	bool IsDynamicPoseFrameIndex(int FrameIndex) const	{ return FrameIndex >= (FrameCountSequences + MaxTransitionPose) && FrameIndex < TotalFrameCount; }
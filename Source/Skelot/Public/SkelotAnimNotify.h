@@ -24,6 +24,12 @@ class ISkelotNotifyInterface
 public:
 	GENERATED_BODY()
 	virtual void OnNotify(ASkelotWorld* SKWorld, FSkelotInstanceHandle Handle, UAnimSequenceBase* Animation) const {}
+	//called once per frame with all of the instances that triggered this notify while playing Animation. default calls OnNotify for each of them
+	virtual void OnNotifyBatch(ASkelotWorld* SKWorld, UAnimSequenceBase* Animation, TConstArrayView<FSkelotInstanceHandle> Handles) const
+	{
+		for (FSkelotInstanceHandle Handle : Handles)
+			OnNotify(SKWorld, Handle, Animation);
+	}
 };
 
 
@@ -43,7 +49,21 @@ public:
 	UFUNCTION(BlueprintImplementableEvent, meta=(DisplayName="触发通知"))
 	void BP_OnNotify(ASkelotWorld* SKWorld, FSkelotInstanceHandle Handle, UAnimSequenceBase* Animation) const;
 
+	UFUNCTION(BlueprintImplementableEvent, meta=(DisplayName="批量触发通知"))
+	void BP_OnNotifyBatch(ASkelotWorld* SKWorld, const TArray<FSkelotInstanceHandle>& Handles, UAnimSequenceBase* Animation) const;
+
+	//if true BP_OnNotifyBatch is called once per frame with all of the triggering instances instead of BP_OnNotify for each of them
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "动画通知", meta = (DisplayName = "批量触发"))
+	bool bReceiveBatch = false;
+
 	void OnNotify(ASkelotWorld* SKWorld, FSkelotInstanceHandle Handle, UAnimSequenceBase* Animation) const final { BP_OnNotify(SKWorld, Handle, Animation); }
+	void OnNotifyBatch(ASkelotWorld* SKWorld, UAnimSequenceBase* Animation, TConstArrayView<FSkelotInstanceHandle> Handles) const final
+	{
+		if (bReceiveBatch)
+			BP_OnNotifyBatch(SKWorld, TArray<FSkelotInstanceHandle>(Handles), Animation);
+		else
+			ISkelotNotifyInterface::OnNotifyBatch(SKWorld, Animation, Handles);
+	}
 };
 
 
@@ -0,0 +1,74 @@
+// Copyright 2024 Lazy Marmot Games. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "SkelotWorldBase.h"
+
+class USkelotRenderParams;
+class USkeletalMesh;
+
+/**
+ * Skelot 命令缓冲 - 在任意线程记录实例修改，由游戏线程批量执行
+ *
+ * ASkelotWorld 的修改函数只能在游戏线程调用。工作线程（AI、投射物等任务）
+ * 可以各自持有一个命令缓冲记录操作，完成后通过 ASkelotWorld::SubmitCommandBuffer 提交。
+ * 记录过程不加锁（每个线程使用自己的缓冲），提交使用无锁 MPSC 队列。
+ *
+ * 执行时机：ASkelotWorld::OnWorldPostActorTick 开始时（速度积分之前）。
+ * 执行顺序（同一缓冲内）：创建 -> 变换 -> 速度 -> 动画 -> 网格挂载 -> 销毁
+ * 创建使用 CreateInstances 批量路径，销毁使用 DestroyInstances 批量路径。
+ *
+ * 注意：缓冲中保存的 RenderParams / Mesh / Animation 为裸指针，调用方需保证其在执行前不被 GC。
+ */
+struct SKELOT_API FSkelotCommandBuffer
+{
+	/** 创建完成回调（游戏线程），参数为本缓冲创建的实例句柄，顺序与 CreateInstance 调用顺序一致 */
+	typedef TFunction<void(TConstArrayView<FSkelotInstanceHandle>)> FOnInstancesCreated;
+
+	void CreateInstance(const FTransform& Transform, USkelotRenderParams* RenderParams, const FSkelotAnimPlayParams* AnimParams = nullptr);
+	void DestroyInstance(FSkelotInstanceHandle Handle);
+	void SetTransform(FSkelotInstanceHandle Handle, const FTransform& Transform);
+	void SetVelocity(FSkelotInstanceHandle Handle, const FVector3f& Velocity);
+	void PlayAnimation(FSkelotInstanceHandle Handle, const FSkelotAnimPlayParams& Params);
+	void AttachMesh(FSkelotInstanceHandle Handle, USkeletalMesh* Mesh, bool bAttach);
+
+	/** 设置创建完成回调 */
+	void SetOnInstancesCreated(FOnInstancesCreated InCallback) { OnInstancesCreated = MoveTemp(InCallback); }
+
+	bool IsEmpty() const;
+	int32 Num() const;
+	void Reset();
+
+private:
+	friend class ASkelotWorld;
+
+	struct FCreateCmd
+	{
+		FTransform Transform;
+		USkelotRenderParams* RenderParams = nullptr;
+		int32 AnimIndex = -1;	//index for AnimParams, -1 if no animation
+	};
+
+	struct FAnimCmd
+	{
+		FSkelotInstanceHandle Handle;
+		FSkelotAnimPlayParams Params;
+	};
+
+	struct FAttachMeshCmd
+	{
+		FSkelotInstanceHandle Handle;
+		USkeletalMesh* Mesh = nullptr;
+		bool bAttach = true;
+	};
+
+	TArray<FCreateCmd> Creates;
+	TArray<FSkelotAnimPlayParams> CreateAnimParams;
+	TArray<FSkelotInstanceHandle> Destroys;
+	TArray<TPair<FSkelotInstanceHandle, FTransform>> Transforms;
+	TArray<TPair<FSkelotInstanceHandle, FVector3f>> Velocities;
+	TArray<FAnimCmd> Animations;
+	TArray<FAttachMeshCmd> MeshAttachments;
+	FOnInstancesCreated OnInstancesCreated;
+};
@@ -26,6 +26,12 @@ public:
 	FSkelotInstanceHandle Handle;
 	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category="Skelot", meta = (DisplayName = "渲染参数"))
 	USkelotRenderParams* RenderParams;
+	//if true transform changes only queue the component, ASkelotWorld writes the final transform of all queued components in one pass before flush.
+	//the instance lags until the end of the frame, use it for many actor driven instances that move often.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Skelot", meta = (DisplayName = "延迟同步变换"))
+	bool bDeferredTransformSync = false;
+	//true while queued in ASkelotWorld::DirtyInstanceComponents
+	bool bTransformSyncPending = false;
 
 	USkelotInstanceComponent();
 
@@ -0,0 +1,93 @@
+// Copyright 2024 Lazy Marmot Games. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "SkelotWorldBase.h"
+#include <atomic>
+
+/**
+ * 实例只读快照 - 供工作线程（音频、小地图、AI感知、网络同步等）读取
+ *
+ * 由游戏线程在 OnWorldPostActorTick 末尾发布，发布后在整个读取期间保持不变。
+ * 数组按实例索引访问，位置以 FVector3d 存储。
+ */
+struct SKELOT_API FSkelotInstanceSnapshot
+{
+	struct FAnimState
+	{
+		//either UAnimSequence* or UAnimComposite*, null if not playing
+		const UAnimSequenceBase* Asset = nullptr;
+		float Time = 0;
+		float PlayRate = 0;
+	};
+
+	//GFrameCounter of the frame it was published
+	uint64 FrameNumber = 0;
+	//number of instances (including destroyed ones), arrays may be larger
+	int32 NumInstance = 0;
+
+	TArray<FVector3d> Locations;
+	TArray<FQuat4f> Rotations;
+	TArray<FVector3f> Velocities;
+	TArray<FAnimState> AnimStates;
+	TArray<uint32> Versions;
+	//one bit per instance, set if alive
+	TArray<uint64> AliveMask;
+
+	bool IsInstanceAlive(int32 InstanceIndex) const
+	{
+		return InstanceIndex >= 0 && InstanceIndex < NumInstance && (AliveMask[InstanceIndex >> 6] >> (InstanceIndex & 63)) & 1;
+	}
+	bool IsHandleValid(FSkelotInstanceHandle H) const
+	{
+		return IsInstanceAlive(H.InstanceIndex) && Versions[H.InstanceIndex] == H.Version;
+	}
+};
+
+/**
+ * 双缓冲快照 - 游戏线程写后台缓冲，通过原子索引交换发布；读者无锁
+ *
+ * 读者通过 FReadScope 获取前台快照，持有期间该缓冲不会被改写。
+ * 若后台缓冲仍被读者持有，本帧跳过发布（读者看到的快照最多延迟一帧）。
+ * 变换数据只复制自上次写入该缓冲以来变换被标脏的实例，其余数据（速度、动画、存活位）每次全量复制。
+ * 若上一帧没有调用 Publish（例如中途关闭过发布），期间的标脏信息已丢失，两个缓冲都会重新全量复制变换。
+ */
+class SKELOT_API FSkelotSnapshotBuffer
+{
+public:
+	class SKELOT_API FReadScope
+	{
+	public:
+		explicit FReadScope(const FSkelotSnapshotBuffer& InOwner);
+		~FReadScope();
+
+		FReadScope(const FReadScope&) = delete;
+		FReadScope& operator=(const FReadScope&) = delete;
+
+		//null if nothing has been published yet
+		const FSkelotInstanceSnapshot* Get() const { return Index != -1 ? &Owner.Buffers[Index] : nullptr; }
+		const FSkelotInstanceSnapshot* operator->() const { return Get(); }
+		explicit operator bool() const { return Index != -1; }
+
+	private:
+		const FSkelotSnapshotBuffer& Owner;
+		int32 Index = -1;
+	};
+
+	//game thread only. copies instance state to the back buffer and makes it the front. returns false if skipped because back buffer is being read.
+	bool Publish(const FSkelotInstancesSOA& SOA, int32 NumInstance);
+	//game thread only. frees both buffers, must not be called while readers exist
+	void Reset();
+
+private:
+	FSkelotInstanceSnapshot Buffers[2];
+	//transform dirty bits accumulated since each buffer was last written
+	TArray<uint64> PendingDirtyMasks[2];
+	//set when dirty bits were missed, next write of the buffer copies every transform
+	bool bNeedsFullTransformCopy[2] = { true, true };
+	//GFrameCounter of the last Publish call
+	uint64 LastPublishFrame = 0;
+	std::atomic<int32> FrontIndex { -1 };
+	mutable std::atomic<int32> NumReaders[2] { {0}, {0} };
+};
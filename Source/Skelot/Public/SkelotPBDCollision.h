@@ -135,7 +135,7 @@ public:
 
 	/**
 	 * 重建障碍物碰撞数据缓存
-	 * 仅在障碍物列表或属性变化时调用
+	 * 仅在障碍物列表或属性变化时调用，读取障碍物 Actor，必须在游戏线程调用
 	 */
 	void RebuildObstacleDataCache(const TArray<TObjectPtr<ASkelotObstacle>>& Obstacles);
 
@@ -147,6 +147,9 @@ public:
 	 */
 	void SolveObstacleCollisions(FSkelotInstancesSOA& SOA, int32 NumInstances, float DeltaTime);
 
+	/** 获取缓存的障碍物数量 */
+	int32 GetNumCachedObstacles() const { return CachedObstacleData.Num(); }
+
 	/** 获取统计信息：处理的碰撞对数量 */
 	int32 GetProcessedCollisionPairs() const { return ProcessedCollisionPairs; }
 
@@ -135,6 +135,70 @@ struct FSkelotLODConfig
 	static FSkelotLODConfig GetRecommendedConfig() { return FSkelotLODConfig{}; }
 };
 
+/**
+ * 重要度（Significance）与预算配置
+ *
+ * 每帧为每个实例计算 0-1 的重要度分数（到观察者距离、屏幕尺寸、最近是否可见、游戏设置的优先级），
+ * 再在全局 CPU 预算内把实例分配到更新档位：档位 N 表示每 2^N 帧更新一次。
+ * 动画、RVO、PBD 各自用自己的最大档位限制降频程度。启用后取代 FSkelotLODConfig 的距离分档。
+ */
+USTRUCT(BlueprintType)
+struct FSkelotSignificanceConfig
+{
+	GENERATED_BODY()
+
+	/** 是否启用重要度与预算管理 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Significance")
+	bool bEnableSignificance = false;
+
+	/** 动画、RVO、PBD 每帧总耗时预算 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Significance", meta = (ClampMin = "0.1", ClampMax = "50", UIMin = "0.1", UIMax = "50", ForceUnits = "ms", EditCondition = "bEnableSignificance"))
+	float CPUBudgetMs = 2.0f;
+
+	/** 超过此距离时距离分数为 0 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Significance", meta = (ClampMin = "100", UIMin = "100", UIMax = "50000", ForceUnits = "cm", EditCondition = "bEnableSignificance"))
+	float MaxDistance = 10000.0f;
+
+	/** 包围球半径占屏幕半高的比例达到此值时屏幕尺寸分数为 1 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Significance", meta = (ClampMin = "0.001", ClampMax = "1", EditCondition = "bEnableSignificance"))
+	float FullScoreScreenSize = 0.1f;
+
+	/** 所在簇在此时间内被渲染过视为可见 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Significance", meta = (ClampMin = "0", ClampMax = "5", ForceUnits = "s", EditCondition = "bEnableSignificance"))
+	float VisibilityGracePeriod = 0.5f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Significance|权重", meta = (ClampMin = "0", EditCondition = "bEnableSignificance"))
+	float DistanceWeight = 1.0f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Significance|权重", meta = (ClampMin = "0", EditCondition = "bEnableSignificance"))
+	float ScreenSizeWeight = 1.0f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Significance|权重", meta = (ClampMin = "0", EditCondition = "bEnableSignificance"))
+	float VisibilityWeight = 1.0f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Significance|权重", meta = (ClampMin = "0", EditCondition = "bEnableSignificance"))
+	float PriorityWeight = 2.0f;
+
+	/** 动画最大档位（3 = 最低每 8 帧更新），降频时按档位放大步进时间 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Significance|档位", meta = (ClampMin = "0", ClampMax = "4", EditCondition = "bEnableSignificance"))
+	int32 AnimationMaxTier = 3;
+
+	/** RVO 最大档位，未更新的实例沿用上次避障后的速度 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Significance|档位", meta = (ClampMin = "0", ClampMax = "4", EditCondition = "bEnableSignificance"))
+	int32 RVOMaxTier = 2;
+
+	/** PBD 最大档位，未更新的实例本帧不被推开，但仍作为邻居推开其他实例 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Significance|档位", meta = (ClampMin = "0", ClampMax = "4", EditCondition = "bEnableSignificance"))
+	int32 PBDMaxTier = 1;
+
+	/** 默认构造 */
+	FSkelotSignificanceConfig() = default;
+
+	static FSkelotSignificanceConfig GetRecommendedConfig() { return FSkelotSignificanceConfig{}; }
+
+	int32 GetMaxTier() const { return FMath::Max3(AnimationMaxTier, RVOMaxTier, PBDMaxTier); }
+};
+
 /**
  * Skelot PBD Plane Actor
  *
@@ -177,6 +241,10 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "LOD更新", meta = (DisplayName = "LOD配置"))
 	FSkelotLODConfig LODConfig;
 
+	/** 重要度与预算配置 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "LOD更新", meta = (DisplayName = "重要度配置"))
+	FSkelotSignificanceConfig SignificanceConfig;
+
 	/** 是否在运行时自动应用配置到 SkelotWorld */
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "配置", meta = (DisplayName = "自动应用配置"))
 	bool bAutoApplyConfig = true;
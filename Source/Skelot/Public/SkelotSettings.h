@@ -25,6 +25,7 @@ class SKELOT_API USkelotDeveloperSettings : public UDeveloperSettingsBackedByCVa
 	GENERATED_BODY()
 public:
 
+	//number of new transitions that can be queued per frame. generation runs in background, see skelot.TransitionGenerationBudgetMS
 	UPROPERTY(Config, EditAnywhere, Category = "设置", meta = (DisplayName = "每帧最大过渡生成数"))
 	int32 MaxTransitionGenerationPerFrame;
 	UPROPERTY(Config, EditAnywhere, Category = "设置", meta = (DisplayName = "集群生命周期"))
@@ -38,5 +39,15 @@ public:
 	UPROPERTY(config, EditAnywhere, Category = "设置", meta = (DisplayName = "集群模式"))
 	ESkelotClusterMode ClusterMode;
 
+	//rarely used per instance data can be stored sparsely (paged) so instances that don't use them don't pay for the memory and bandwidth
+	UPROPERTY(Config, EditAnywhere, Category = "内存", meta = (DisplayName = "稀疏存储根运动"))
+	bool bSparseRootMotions;
+	UPROPERTY(Config, EditAnywhere, Category = "内存", meta = (DisplayName = "稀疏存储用户对象"))
+	bool bSparseUserObjects = false;
+	UPROPERTY(Config, EditAnywhere, Category = "内存", meta = (DisplayName = "稀疏存储附加数据"))
+	bool bSparseMiscData = false;
+	UPROPERTY(Config, EditAnywhere, Category = "内存", meta = (DisplayName = "稀疏存储自定义数据"))
+	bool bSparseCustomData = false;
+
 	USkelotDeveloperSettings(const FObjectInitializer& Initializer);
 };
\ No newline at end of file
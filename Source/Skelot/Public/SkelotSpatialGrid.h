@@ -147,6 +147,19 @@ public:
 	 */
 	const TArray<int32>* GetCellInstances(const FIntVector& CellKey) const;
 
+	/**
+	 * 遍历所有非空单元
+	 * @param Proc 回调 (const FIntVector& CellKey, const TArray<int32>& Instances)
+	 */
+	template<typename TLambda>
+	void ForEachCell(TLambda Proc) const
+	{
+		for (const TPair<FSkelotCellKey, TArray<int32>>& Pair : GridCells)
+		{
+			Proc(Pair.Key.Coord, Pair.Value);
+		}
+	}
+
 	/** 获取网格统计信息 */
 	int32 GetNumCells() const { return GridCells.Num(); }
 	int32 GetTotalInstancesInGrid() const { return TotalInstances; }
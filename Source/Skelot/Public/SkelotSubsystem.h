@@ -19,6 +19,16 @@ class SKELOT_API USkelotWorldSubsystem : public UWorldSubsystem
 public:
 	UPROPERTY()
 	ASkelotWorld* PrimaryInstance;
+	//independent simulation shards, [0] is PrimaryInstance. each has its own SOA, spatial grid and PBD/RVO solvers, handles encode their shard.
+	UPROPERTY()
+	TArray<ASkelotWorld*> Shards;
+
+	template<typename TLambda> void ForEachShard(TLambda Proc)
+	{
+		for (ASkelotWorld* Shard : Shards)
+			if (IsValid(Shard))
+				Proc(Shard);
+	}
 
 	USkelotWorldSubsystem_Impl* Impl() { return (USkelotWorldSubsystem_Impl*)this; }
 
@@ -31,7 +41,10 @@ public:
 	static ASkelotWorld* Internal_GetSingleton(const UWorld* World, bool bCreateIfNotFound);
 	static ASkelotWorld* Internal_GetSingleton(const UObject* WorldContextObject, bool bCreateIfNotFound);
 
-	//helper to get singleton and also check validity of the handle
+	//returns the shard of the specified index, 0 is the primary singleton. shards that don't interact can be used for separate crowds (arenas, ...)
+	static ASkelotWorld* GetShard(const UObject* WorldContextObject, int32 ShardIndex, bool bCreateIfNotFound = true);
+
+	//helper to get singleton and also check validity of the handle. the shard encoded in the handle is used
 	static ASkelotWorld* GetSingleton(const UObject* WorldContextObject, FSkelotInstanceHandle Handle);
 	static ASkelotWorld* GetSingleton(const UObject* WorldContextObject, FSkelotInstanceHandle Handle0, FSkelotInstanceHandle Handle1);
 
@@ -48,6 +61,30 @@ public:
 	UFUNCTION(BlueprintCallable, Category="Skelot|实例", meta=(WorldContext="WorldContextObject", DisplayName = "批量创建实例"))
 	static void Skelot_CreateInstances(const UObject* WorldContextObject, const TArray<FTransform>& Transforms, USkelotRenderParams* RenderParams, TArray<FSkelotInstanceHandle>& OutHandles);
 
+	//////////////////////////////////////////////////////////////////////////
+	// Batch API
+	// 批量 API - 一次调用处理整个句柄数组，避免蓝图循环的逐节点开销
+	// 值数组需与句柄数组一一对应，或只含一个值（应用到所有句柄）；无效句柄被跳过
+	// 句柄可以属于不同分片，按分片分组后交给各自的 ASkelotWorld 处理
+
+	UFUNCTION(BlueprintCallable, Category="Skelot|批量", meta=(WorldContext="WorldContextObject", DisplayName = "批量设置变换"))
+	static void Skelot_SetTransforms(const UObject* WorldContextObject, const TArray<FSkelotInstanceHandle>& Handles, const TArray<FTransform>& Transforms);
+	//////////////////////////////////////////////////////////////////////////
+	//invalid handles get zero vector
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category="Skelot|批量", meta=(WorldContext="WorldContextObject", DisplayName = "批量获取位置"))
+	static void Skelot_GetLocations(const UObject* WorldContextObject, const TArray<FSkelotInstanceHandle>& Handles, TArray<FVector>& OutLocations);
+	//////////////////////////////////////////////////////////////////////////
+	UFUNCTION(BlueprintCallable, Category="Skelot|批量", meta=(WorldContext="WorldContextObject", DisplayName = "批量播放动画"))
+	static void Skelot_PlayAnimations(const UObject* WorldContextObject, const TArray<FSkelotInstanceHandle>& Handles, const TArray<FSkelotAnimPlayParams>& Params);
+	//////////////////////////////////////////////////////////////////////////
+	//Values holds NumFloatPerInstance floats for each handle, or just NumFloatPerInstance floats for all of them
+	UFUNCTION(BlueprintCallable, Category="Skelot|批量", meta=(WorldContext="WorldContextObject", DisplayName = "批量设置自定义数据"))
+	static void Skelot_SetCustomDataFloats(const UObject* WorldContextObject, const TArray<FSkelotInstanceHandle>& Handles, int32 Offset, int32 NumFloatPerInstance, const TArray<float>& Values);
+	//////////////////////////////////////////////////////////////////////////
+	//attach (or detach) Meshes[i] to Handles[i], a single mesh is used for all of the handles. see Skelot_AttachMeshes for multiple meshes on one instance
+	UFUNCTION(BlueprintCallable, Category="Skelot|批量", meta=(WorldContext="WorldContextObject", DisplayName = "批量附加网格体"))
+	static void Skelot_AttachMeshToInstances(const UObject* WorldContextObject, const TArray<FSkelotInstanceHandle>& Handles, const TArray<USkeletalMesh*>& Meshes, bool bAttach = true);
+
 	//////////////////////////////////////////////////////////////////////////
 	UFUNCTION(BlueprintCallable, Category="Skelot|动画", meta=(WorldContext="WorldContextObject", DisplayName = "播放动画"))
 	static float Skelot_PlayAnimation(const UObject* WorldContextObject, FSkelotInstanceHandle Handle, const FSkelotAnimPlayParams& Params);
@@ -367,6 +404,48 @@ public:
 	UFUNCTION(BlueprintCallable, Category="Skelot|杂项", meta=(WorldContext="WorldContextObject", DisplayName = "设置根运动参数"))
 	static void SetRootMotionParams(const UObject* WorldContextObject, FSkelotInstanceHandle Handle, bool bExtractRootMotion, bool bApplyRootMotion);
 
+	//////////////////////////////////////////////////////////////////////////
+	//gameplay priority used by significance (0-255), 255 means always update every frame. see FSkelotSignificanceConfig
+	UFUNCTION(BlueprintCallable, Category="Skelot|LOD", meta=(WorldContext="WorldContextObject", DisplayName = "设置重要度优先级"))
+	static void Skelot_SetSignificancePriority(const UObject* WorldContextObject, FSkelotInstanceHandle Handle, uint8 Priority);
+	//////////////////////////////////////////////////////////////////////////
+	//significance score (0-1) computed this frame, 0 if significance is disabled
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category="Skelot|LOD", meta=(WorldContext="WorldContextObject", DisplayName = "获取重要度"))
+	static float Skelot_GetSignificance(const UObject* WorldContextObject, FSkelotInstanceHandle Handle);
+
+	//////////////////////////////////////////////////////////////////////////
+	// Group & Tag API
+	// 分组与标签 API - 按分组或标签位批量操作（作用于主 Skelot 单例）
+
+	//group id of the instance (squad, formation ...), -1 removes it from its group
+	UFUNCTION(BlueprintCallable, Category="Skelot|分组", meta=(WorldContext="WorldContextObject", DisplayName = "设置实例分组"))
+	static void Skelot_SetInstanceGroup(const UObject* WorldContextObject, FSkelotInstanceHandle Handle, int32 GroupId);
+	//////////////////////////////////////////////////////////////////////////
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category="Skelot|分组", meta=(WorldContext="WorldContextObject", DisplayName = "获取实例分组"))
+	static int32 Skelot_GetInstanceGroup(const UObject* WorldContextObject, FSkelotInstanceHandle Handle);
+	//////////////////////////////////////////////////////////////////////////
+	//64 tag bits whose meaning is defined by the game (team, unit type ...)
+	UFUNCTION(BlueprintCallable, Category="Skelot|分组", meta=(WorldContext="WorldContextObject", DisplayName = "设置实例标签"))
+	static void Skelot_SetInstanceTags(const UObject* WorldContextObject, FSkelotInstanceHandle Handle, int64 Tags);
+	//////////////////////////////////////////////////////////////////////////
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category="Skelot|分组", meta=(WorldContext="WorldContextObject", DisplayName = "获取实例标签"))
+	static int64 Skelot_GetInstanceTags(const UObject* WorldContextObject, FSkelotInstanceHandle Handle);
+	//////////////////////////////////////////////////////////////////////////
+	UFUNCTION(BlueprintCallable, Category="Skelot|分组", meta=(WorldContext="WorldContextObject", DisplayName = "按筛选查询实例"))
+	static void Skelot_QueryInstancesByFilter(const UObject* WorldContextObject, const FSkelotInstanceFilter& Filter, TArray<FSkelotInstanceHandle>& OutHandles);
+	//////////////////////////////////////////////////////////////////////////
+	UFUNCTION(BlueprintCallable, Category="Skelot|分组", meta=(WorldContext="WorldContextObject", DisplayName = "按筛选播放动画"))
+	static int32 Skelot_PlayAnimationByFilter(const UObject* WorldContextObject, const FSkelotInstanceFilter& Filter, const FSkelotAnimPlayParams& Params);
+	//////////////////////////////////////////////////////////////////////////
+	UFUNCTION(BlueprintCallable, Category="Skelot|分组", meta=(WorldContext="WorldContextObject", DisplayName = "按筛选设置速度"))
+	static void Skelot_SetVelocityByFilter(const UObject* WorldContextObject, const FSkelotInstanceFilter& Filter, const FVector3f& Velocity);
+	//////////////////////////////////////////////////////////////////////////
+	UFUNCTION(BlueprintCallable, Category="Skelot|分组", meta=(WorldContext="WorldContextObject", DisplayName = "按筛选设置自定义数据"))
+	static void Skelot_SetCustomDataFloatsByFilter(const UObject* WorldContextObject, const FSkelotInstanceFilter& Filter, int32 Offset, const TArray<float>& Values);
+	//////////////////////////////////////////////////////////////////////////
+	UFUNCTION(BlueprintCallable, Category="Skelot|分组", meta=(WorldContext="WorldContextObject", DisplayName = "按筛选销毁实例"))
+	static int32 Skelot_DestroyInstancesByFilter(const UObject* WorldContextObject, const FSkelotInstanceFilter& Filter);
+
 };
 
 
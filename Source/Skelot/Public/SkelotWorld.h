@@ -7,10 +7,14 @@
 #include "SkelotSpatialGrid.h"
 #include "SkelotPBDCollision.h"
 #include "SkelotRVOSystem.h"
+#include "SkelotCommandBuffer.h"
+#include "SkelotInstanceSnapshot.h"
+#include "Containers/Queue.h"
 #include "SkelotWorld.generated.h"
 
 enum class ESkelotClusterMode : uint8;
 class ASkelotObstacle;
+class USkelotInstanceComponent;
 
 /*
 Skelot Singleton Actor, spawned automatically if not already in the world. (you may need to edit default properties ).
@@ -35,6 +39,8 @@ public:
 	uint32 MaxSubmeshPerInstance;
 	ESkelotClusterMode ClusterMode;
 	FVector ViewCenterForClusters;
+	//index of this world in USkelotWorldSubsystem::Shards, encoded in the handles of its instances. 0 for the primary world
+	uint32 ShardIndex = 0;
 
 	UPROPERTY(Transient)
 	FSkelotInstancesSOA SOA;
@@ -43,19 +49,26 @@ public:
 	TSet<FSkelotInstanceRenderDescFinal> RenderDescs;
 	//
 	TSparseArray<FSkelotAttachParentData> AttachParentArray;
+	//instance index of attached children sorted by depth, parents always come before their children. rebuilt when attachments change.
+	TArray<int32> HierarchyOrder;
+	//HierarchyOrder[HierarchyDepthOffsets[D] .. HierarchyDepthOffsets[D + 1]) are the children at depth D + 1
+	TArray<int32, TInlineAllocator<8>> HierarchyDepthOffsets;
+	bool bHierarchyOrderDirty = false;
 	//
 	UPROPERTY(Transient)
 	TMap<int32, FSkelotFrag_DynPoseTie> DynamicPosTiedMap;
 	//index of instances whose ClusterIndex is -1
 	TArray<int32> InstancesNeedCluster;
-	//
-	uint32 ClusterUpdateCounter;
+	//instance index of group members by group id, order is not kept. see SetInstanceGroup
+	TMap<int32, TArray<int32>> GroupMembers;
 	
 	//
 	FAnimNotifyContext AnimationNotifyContext;
 	TArray<FSkelotAnimFinishEvent> AnimationFinishEvents;
 	TArray<FSkelotAnimNotifyEvent> AnimationNotifyEvents;
 	TArray<FSkelotAnimNotifyObjectEvent> AnimationNotifyObjectEvents;
+	//reused by the grouped event delegates
+	TArray<FSkelotAnimEventBatch> AnimationEventBatches;
 	
 	//if true UAnimNotify* will be process, only skelot notifies are supported. see ISkelotNotifyInterface.
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Skelot|动画", meta=(DisplayName="启用动画通知对象"))
@@ -73,12 +86,39 @@ public:
 	//is called for name only notifications (name notifications are enabled by default)
 	UPROPERTY(BlueprintAssignable, meta = (DisplayName = "动画通知时"), Category = "Skelot|动画")
 	FOnAnimNotify OnAnimationNotifyDelegate;
+
+	DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FOnAnimEventBatches, ASkelotWorld*, Context, const TArray<FSkelotAnimEventBatch>&, Batches);
+
+	//same as OnAnimationFinishedDelegate but events are grouped by sequence, one handle array per group. only computed if bound
+	UPROPERTY(BlueprintAssignable, meta = (DisplayName = "动画播放完成时(分组)"), Category = "Skelot|动画")
+	FOnAnimEventBatches OnAnimationFinishedBatchDelegate;
+	//same as OnAnimationNotifyDelegate but events are grouped by notify name and sequence, one handle array per group. only computed if bound
+	UPROPERTY(BlueprintAssignable, meta = (DisplayName = "动画通知时(分组)"), Category = "Skelot|动画")
+	FOnAnimEventBatches OnAnimationNotifyBatchDelegate;
+	//if false OnAnimationFinishedDelegate and OnAnimationNotifyDelegate are not broadcast, use it when only the grouped delegates are bound
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Skelot|动画", meta=(DisplayName="广播逐事件委托"))
+	bool bBroadcastPerEventAnimDelegates = true;
 	//
 	UPROPERTY(Transient)
 	TMap<FSkelotInstanceHandle, double> LifeSpanMap;
 	//
 	UPROPERTY(Transient)
 	TMap<FSkelotInstanceHandle, FSkelotInstanceTimerData> TimerMap;
+	//min heaps keyed on expiry time so that ticking only touches expired entries.
+	//entries are invalidated lazily, an entry is stale if its time doesn't match the one in LifeSpanMap/TimerMap.
+	TArray<FSkelotExpiryHeapEntry> LifeSpanHeap;
+	TArray<FSkelotExpiryHeapEntry> TimerHeaps[2];
+
+	//command buffers submitted from any thread, see SubmitCommandBuffer
+	TQueue<FSkelotCommandBuffer, EQueueMode::Mpsc> PendingCommandBuffers;
+	//components with bDeferredTransformSync whose transform changed this frame, see SyncInstanceComponentTransforms
+	TArray<TWeakObjectPtr<USkelotInstanceComponent>> DirtyInstanceComponents;
+
+	// 是否每帧发布只读实例快照，供工作线程无锁读取（见 ReadInstanceSnapshot）
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Skelot|快照", meta = (DisplayName = "发布实例快照"))
+	bool bPublishInstanceSnapshot = false;
+
+	FSkelotSnapshotBuffer InstanceSnapshot;
 
 	//////////////////////////////////////////////////////////////////////////
 	// Spatial Grid for efficient spatial queries
@@ -88,21 +128,26 @@ public:
 	mutable FSkelotSpatialGrid SpatialGrid;
 
 	// 关闭空间网格开关时的共享回退网格，供 PBD/RVO 在同帧复用
-	mutable FSkelotSpatialGrid FallbackSpatialGrid;
+	FSkelotSpatialGrid FallbackSpatialGrid;
 
 	// 记录回退网格上次构建的帧，避免同帧重复整表重建
-	mutable uint64 FallbackSpatialGridFrame = MAX_uint64;
+	uint64 FallbackSpatialGridFrame = MAX_uint64;
 
 	struct FPendingVelocityAdvance
 	{
-		FVector3f DesiredVelocity = FVector3f::ZeroVector;
-		float DeltaTime = 0.0f;
-		bool bPreferCurrentVelocityForMovement = false;
-		bool bRotateToMovement = true;
+		int32 InstanceIndex;
+		FVector3f DesiredVelocity;
+		float DeltaTime;
+		bool bPreferCurrentVelocityForMovement;
+		bool bRotateToMovement;
 	};
 
-	// 等待在 world tick 中统一积分的位置更新，确保先求解 RVO/PBD 再推进位移
-	TMap<int32, FPendingVelocityAdvance> PendingVelocityAdvances;
+	// AdvanceInstancesByVelocity 提交的一次性位移，在速度积分时统一处理，确保先求解 RVO/PBD 再推进位移
+	TArray<FPendingVelocityAdvance> PendingVelocityAdvances;
+
+	DECLARE_DELEGATE_TwoParams(FOnGroundSnap, ASkelotWorld*, TConstArrayView<int32>);
+	// 速度积分之后调用，参数为本帧移动过且标记了 bSnapToGround 的实例，用于贴地（射线检测/高度图等）
+	FOnGroundSnap OnGroundSnap;
 
 	// 是否启用空间网格优化
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Skelot|空间查询", meta = (DisplayName = "启用空间网格"))
@@ -155,9 +200,36 @@ public:
 	// LOD 更新帧计数器
 	int32 LODUpdateFrameCounter = 0;
 
-	// 相机位置缓存（用于 LOD 距离计算）
+	// 第一个观察者的位置缓存（调试绘制用）
 	FVector CachedCameraLocation = FVector::ZeroVector;
 
+	// 按 LOD 级别分组的实例索引（0=近 1=中 2=远），每帧由预处理填充，动画更新只遍历本帧到期的分组
+	TArray<int32> LODBuckets[3];
+
+	// 玩家相机之外的观察者 Actor（分屏、观战、远程摄像机等），按 90 度 FOV 计算屏幕尺寸
+	UPROPERTY(Transient)
+	TArray<TWeakObjectPtr<AActor>> ViewerActors;
+
+	// 直接指定的观察者位置（如专用服务器上的玩家位置），参与 LOD 与重要度计算
+	TArray<FVector> ViewerLocations;
+
+	//////////////////////////////////////////////////////////////////////////
+	// Significance System
+	// 重要度系统 - 统一计算实例重要度，在 CPU 预算内决定动画/RVO/PBD 的更新频率
+
+	// 重要度配置参数
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Skelot|LOD更新", meta = (DisplayName = "重要度配置"))
+	FSkelotSignificanceConfig SignificanceConfig;
+
+	// 自上次分档以来动画/RVO/PBD 的实测耗时（周期数）
+	uint64 SignificanceMeasuredCycles = 0;
+
+	// 平滑后的单次实例更新耗时（毫秒）
+	float SignificanceCostPerUpdateMs = 0;
+
+	// 上次分档计划的每帧实例更新次数
+	float SignificancePlannedLoad = 0;
+
 	//////////////////////////////////////////////////////////////////////////
 	// Obstacle System
 	// 障碍物系统 - PBD 碰撞的静态障碍物
@@ -180,6 +252,11 @@ public:
 
 	static ASkelotWorld* Get(const UObject* Context, bool bCreateIfNotFound = true);
 	static ASkelotWorld* Get(const UWorld* World, bool bCreateIfNotFound = true);
+	//returns the shard that owns the handle, null if that shard doesn't exist
+	static ASkelotWorld* Get(const UObject* Context, FSkelotInstanceHandle Handle);
+
+	//must be called before any instance is created, see USkelotWorldSubsystem::GetShard
+	void SetShardIndex(uint32 InShardIndex);
 
 	//cast to private implementation
 	ASkelotWorld_Impl* Impl() { return (ASkelotWorld_Impl*)this; }
@@ -213,6 +290,16 @@ public:
 			if(IsInstanceAlive(InstanceIndex))
 				Proc(InstanceIndex);
 	}
+	/*
+	calls Functor(InstanceIndex, Columns[InstanceIndex]...) for every alive instance in parallel, dead slots are skipped 64 at a time and batch size is automatic.
+	columns give typed access to SOA arrays, e.g :
+	ParallelForEachAliveInstance(EParallelForFlags::None, [](int32 Index, FVector3d& Location, const FVector3f& Velocity) { ... }, SOA.Locations, SOA.Velocities);
+	game thread only, the functor must only write data of the instance it is called for. see FSkelotInstancesSOA::ParallelForEachAlive
+	*/
+	template<typename TFunctor, typename... TColumns> void ParallelForEachAliveInstance(EParallelForFlags Flags, TFunctor&& Functor, TColumns&... Columns) const
+	{
+		SOA.ParallelForEachAlive(GetNumInstance(), Flags, Forward<TFunctor>(Functor), Columns...);
+	}
 
 	//////////////////////////////////////////////////////////////////////////
 	//create an Skelot Instance, fast enough so don't think of pooling them
@@ -221,14 +308,48 @@ public:
 	FSkelotInstanceHandle CreateInstance(const FTransform& Transform, FSetElementId DescId);
 
 	//////////////////////////////////////////////////////////////////////////
-	//batch create multiple Skelot Instances, more efficient than calling CreateInstance in a loop
-	void CreateInstances(const TArray<FTransform>& Transforms, const FSkelotInstanceRenderDesc& Desc, TArray<FSkelotInstanceHandle>& OutHandles);
-	void CreateInstances(const TArray<FTransform>& Transforms, USkelotRenderParams* RenderParams, TArray<FSkelotInstanceHandle>& OutHandles);
+	//batch create multiple Skelot Instances, more efficient than calling CreateInstance in a loop.
+	//handles are allocated as one span, SOA columns are filled in parallel and instances are queued for cluster assignment once.
+	//if AnimParams is not null the animation is played on all of the new instances.
+	void CreateInstances(TConstArrayView<FTransform> Transforms, const FSkelotInstanceRenderDesc& Desc, TArray<FSkelotInstanceHandle>& OutHandles, const FSkelotAnimPlayParams* AnimParams = nullptr);
+	void CreateInstances(TConstArrayView<FTransform> Transforms, USkelotRenderParams* RenderParams, TArray<FSkelotInstanceHandle>& OutHandles, const FSkelotAnimPlayParams* AnimParams = nullptr);
+	void CreateInstances(TConstArrayView<FTransform> Transforms, FSetElementId DescId, TArray<FSkelotInstanceHandle>& OutHandles, const FSkelotAnimPlayParams* AnimParams = nullptr);
+
+	//grow the SOA arrays so that at least NumInstances can be alive without reallocation. call it before spawning big waves.
+	void ReserveInstances(int32 NumInstances);
 
 	//////////////////////////////////////////////////////////////////////////
 	//destroy an instance
 	void DestroyInstance(int32 InstanceIndex);
 	void DestroyInstance(FSkelotInstanceHandle H);
+	//batch destroy, invalid or duplicate handles are ignored
+	void DestroyInstances(TConstArrayView<FSkelotInstanceHandle> Handles);
+
+	//////////////////////////////////////////////////////////////////////////
+	//batch versions of the per instance setters/getters, handles are validated once per entry and invalid ones are skipped.
+	//value arrays must either match the handle array or hold a single value that is used for all of the handles.
+	//transforms, locations and dense custom data are processed in parallel, a handle must not appear twice.
+	void SetInstanceTransforms(TConstArrayView<FSkelotInstanceHandle> Handles, TConstArrayView<FTransform> Transforms);
+	//invalid handles get zero vector
+	void GetInstanceLocations(TConstArrayView<FSkelotInstanceHandle> Handles, TArray<FVector>& OutLocations) const;
+	void InstancesPlayAnimation(TConstArrayView<FSkelotInstanceHandle> Handles, TConstArrayView<FSkelotAnimPlayParams> Params);
+	//Values holds Count floats per handle, or just Count floats for all of them
+	void SetInstancesCustomDataFloat(TConstArrayView<FSkelotInstanceHandle> Handles, TConstArrayView<float> Values, int32 Offset, int32 Count);
+	void InstancesAttachMesh(TConstArrayView<FSkelotInstanceHandle> Handles, TConstArrayView<USkeletalMesh*> Meshes, bool bAttach);
+
+	//////////////////////////////////////////////////////////////////////////
+	//thread safe. queues commands recorded on any thread, they are applied on game thread at the start of next OnWorldPostActorTick. Buffer is left empty.
+	void SubmitCommandBuffer(FSkelotCommandBuffer&& Buffer);
+	//applies all submitted command buffers, game thread only. called automatically by OnWorldPostActorTick
+	void FlushCommandBuffers();
+	//game thread only. queues the component so that its transform is written once by SyncInstanceComponentTransforms
+	void MarkInstanceComponentDirty(USkelotInstanceComponent* Component);
+	//writes the transform of all queued components to their instances, called automatically by OnWorldPostActorTick
+	void SyncInstanceComponentTransforms();
+
+	//thread safe. read access to the snapshot published at the end of the last frame, requires bPublishInstanceSnapshot.
+	//the snapshot stays unchanged while the returned scope is alive, don't hold it longer than a frame.
+	FSkelotSnapshotBuffer::FReadScope ReadInstanceSnapshot() const { return FSkelotSnapshotBuffer::FReadScope(InstanceSnapshot); }
 
 	//////////////////////////////////////////////////////////////////////////
 	//changes the render params of an instance, better to use this instead of individual functions like SetInstanceMaterial, InstanceAttachMeshes, ...
@@ -237,9 +358,9 @@ public:
 	void SetInstanceRenderParams(int32 InstanceIndex, FSetElementId DescId);
 	
 
-	//returns pointer to the 0xFF terminated mesh indices array. value is index for FSkelotInstanceRenderDesc.Meshes[]
-	uint8* GetInstanceSubmeshIndices(int32 InstanceIndex)				{ return SOA.SubmeshIndices.GetData() + (InstanceIndex * (MaxSubmeshPerInstance + 1)); }
-	const uint8* GetInstanceSubmeshIndices(int32 InstanceIndex) const	{ return SOA.SubmeshIndices.GetData() + (InstanceIndex * (MaxSubmeshPerInstance + 1)); }
+	//returns bit mask of attached meshes. bit index is index for FSkelotInstanceRenderDesc.Meshes[]
+	FSkelotSubmeshMask& GetInstanceSubmeshMask(int32 InstanceIndex)				{ return SOA.SubmeshMasks[InstanceIndex]; }
+	const FSkelotSubmeshMask& GetInstanceSubmeshMask(int32 InstanceIndex) const	{ return SOA.SubmeshMasks[InstanceIndex]; }
 
 	//functions to attach/detach meshes 
 	bool InstanceAttachMesh_ByName(int32 InstanceIndex, FName Name /*Name of FSkelotInstanceRenderDesc.Meshes[].Name */, bool bAttach);
@@ -314,6 +435,7 @@ public:
 			SOA.Locations[InstanceIndex] = T.GetLocation(); 
 			SOA.Rotations[InstanceIndex] = (FQuat4f)T.GetRotation();
 			SOA.Scales[InstanceIndex]	 = (FVector3f)T.GetScale3D();
+			SOA.MarkTransformDirty(InstanceIndex);
 		}
 	}
 	//
@@ -322,6 +444,7 @@ public:
 		if (IsInstanceAlive(InstanceIndex))
 		{
 			SOA.Locations[InstanceIndex] = L;
+			SOA.MarkTransformDirty(InstanceIndex);
 		}
 	}
 	//
@@ -330,6 +453,7 @@ public:
 		if (IsInstanceAlive(InstanceIndex))
 		{
 			SOA.Rotations[InstanceIndex] = Q;
+			SOA.MarkTransformDirty(InstanceIndex);
 		}
 	}
 	//
@@ -339,6 +463,7 @@ public:
 		{
 			SOA.Locations[InstanceIndex] = L;
 			SOA.Rotations[InstanceIndex] = Q;
+			SOA.MarkTransformDirty(InstanceIndex);
 		}
 	}
 
@@ -357,9 +482,14 @@ public:
 	void SetInstanceVelocities(const TArray<int32>& InstanceIndices, const TArray<FVector3f>& Velocities);
 	//batch set velocities using handles
 	void SetInstanceVelocities(const TArray<FSkelotInstanceHandle>& Handles, const TArray<FVector3f>& Velocities);
-	//queue batch movement update from desired velocities; world tick will integrate after RVO/PBD
+	//set desired velocities and move the instances once by DeltaTime; world tick will integrate after RVO/PBD.
+	//bPreferCurrentVelocityForMovement moves by the velocity solved by RVO/PBD, or by the desired one if that is nearly zero.
+	//prefer SetInstanceVelocityIntegration for persistent movement.
 	void AdvanceInstancesByVelocity(const TArray<int32>& InstanceIndices, const TArray<FVector3f>& DesiredVelocities, float DeltaTime, bool bPreferCurrentVelocityForMovement, bool bRotateToMovement = true);
-	void ConsumePendingVelocityAdvances();
+	//opt the instance in/out of native velocity integration. integrated instances move by SOA.Velocities every frame after RVO/PBD.
+	//bFaceVelocity rotates the instance toward its velocity, bSnapToGround passes the instance to OnGroundSnap after it moved.
+	void SetInstanceVelocityIntegration(int32 InstanceIndex, bool bEnable, bool bFaceVelocity = false, bool bSnapToGround = false);
+	bool IsInstanceVelocityIntegrated(int32 InstanceIndex) const { return IsInstanceAlive(InstanceIndex) && SOA.Slots[InstanceIndex].bIntegrateVelocity; }
 
 	//////////////////////////////////////////////////////////////////////////
 	// Collision Channel API - for PBD collision and RVO avoidance systems
@@ -477,8 +607,14 @@ public:
 	float* GetInstanceCustomDataFloats(int32 InstanceIndex)
 	{
 		check(IsValidInstanceIndex(InstanceIndex));
-		//intentionally not [] operator because might be: PerInstanceCustomData.Num() == 0 && MaxNumCustomDataFloat == 0
-		return this->SOA.PerInstanceCustomData.GetData() + (InstanceIndex * SOA.MaxNumCustomDataFloat);
+		//intentionally not [] operator because might be: MaxNumCustomDataFloat == 0
+		return this->SOA.PerInstanceCustomData.GetMutable(InstanceIndex);
+	}
+	//read only version, returns null if custom data is sparse and instance has never been written
+	const float* FindInstanceCustomDataFloats(int32 InstanceIndex) const
+	{
+		check(IsValidInstanceIndex(InstanceIndex));
+		return this->SOA.PerInstanceCustomData.Find(InstanceIndex);
 	}
 
 	//destroy all the attached Skelot Instances
@@ -518,6 +654,8 @@ public:
 
 	void Internal_CallOnAnimationFinished();
 	void Internal_CallOnAnimationNotify();
+	//called by USkelotAnimCollection::DefragTransitionPool on every world right after transitions were moved, points instances to the new frames
+	void RemapRelocatedTransitionFrames(const USkelotAnimCollection* AnimCollection);
 
 	//
 	virtual void OnAnimationFinished(const TArray<FSkelotAnimFinishEvent>& Events) {}
@@ -578,11 +716,11 @@ public:
 	int32 GetSpatialGridFrameStride() const;
 
 	/**
-	 * 重建空间网格（内部使用，每帧自动调用）
+	 * 重建空间网格（内部使用，每帧自动调用）；关闭主网格且启用 PBD/RVO 时构建回退网格
 	 */
 	void RebuildSpatialGrid();
 
-	// 选择邻居查询使用的空间网格；关闭主网格时会按帧构建共享回退网格
+	// 选择邻居查询使用的空间网格；关闭主网格时返回本帧 RebuildSpatialGrid 构建的回退网格
 	const FSkelotSpatialGrid& GetNeighborQuerySpatialGrid() const;
 
 	//////////////////////////////////////////////////////////////////////////
@@ -727,6 +865,23 @@ public:
 	 */
 	const FSkelotLODConfig& GetLODConfig() const { return LODConfig; }
 
+	/**
+	 * 注册额外的观察者，LOD 取到最近观察者的距离，重要度取所有观察者中的最大值
+	 * @param Viewer 观察者 Actor（所有玩家控制器的视点会自动加入，无需注册）
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Skelot|LOD")
+	void RegisterViewer(AActor* Viewer);
+
+	UFUNCTION(BlueprintCallable, Category = "Skelot|LOD")
+	void UnregisterViewer(AActor* Viewer);
+
+	/**
+	 * 设置额外的观察者位置（替换之前设置的位置），与注册的观察者 Actor 一起使用
+	 * @param Locations 世界空间位置
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Skelot|LOD")
+	void SetViewerLocations(const TArray<FVector>& Locations);
+
 	/**
 	 * 检查实例是否应该在本帧更新（基于 LOD 距离）
 	 * @param InstanceIndex 实例索引
@@ -735,12 +890,78 @@ public:
 	bool ShouldUpdateInstanceLOD(int32 InstanceIndex) const;
 
 	/**
-	 * 获取实例的 LOD 更新频率级别
+	 * 获取实例的 LOD 更新频率级别（本帧预处理的结果，不做距离计算）
 	 * @param InstanceIndex 实例索引
 	 * @return 0=近（每帧）, 1=中（每2帧）, 2=远（每4帧）
 	 */
 	int32 GetInstanceLODLevel(int32 InstanceIndex) const;
 
+	//////////////////////////////////////////////////////////////////////////
+	// Significance API
+	// 重要度 API
+
+	/**
+	 * 设置重要度配置，关闭时所有实例恢复每帧更新
+	 * @param InConfig 重要度配置结构体
+	 */
+	void SetSignificanceConfig(const FSkelotSignificanceConfig& InConfig);
+
+	const FSkelotSignificanceConfig& GetSignificanceConfig() const { return SignificanceConfig; }
+
+	/**
+	 * 设置实例的游戏优先级（0-255），255 表示始终每帧更新（不受预算限制，如玩家角色、Boss）
+	 */
+	void SetInstanceSignificancePriority(int32 InstanceIndex, uint8 Priority) { if (IsInstanceAlive(InstanceIndex)) { SOA.SignificancePriorities[InstanceIndex] = Priority; } }
+	uint8 GetInstanceSignificancePriority(int32 InstanceIndex) const { return IsInstanceAlive(InstanceIndex) ? SOA.SignificancePriorities[InstanceIndex] : 0; }
+
+	/** 实例上一次计算的重要度分数（0-1），未启用重要度时为 0 */
+	float GetInstanceSignificance(int32 InstanceIndex) const { return IsInstanceAlive(InstanceIndex) ? SOA.Significances[InstanceIndex] : 0; }
+
+	/** 实例当前的更新档位，每 2^档位 帧更新一次（各系统再受自身最大档位限制） */
+	int32 GetInstanceUpdateTier(int32 InstanceIndex) const { return IsInstanceAlive(InstanceIndex) ? SOA.SignificanceTiers[InstanceIndex] : 0; }
+
+	//////////////////////////////////////////////////////////////////////////
+	// Group & Tag API
+	// 分组与标签 API - 按分组或标签位批量操作实例，避免在游戏逻辑中维护句柄数组
+
+	/**
+	 * 设置实例所属分组（如小队编号），每个实例最多属于一个分组，销毁时自动移出
+	 * @param GroupId 分组编号，-1 表示移出分组
+	 */
+	void SetInstanceGroup(int32 InstanceIndex, int32 GroupId);
+	int32 GetInstanceGroup(int32 InstanceIndex) const { return IsInstanceAlive(InstanceIndex) ? SOA.Groups[InstanceIndex].GroupId : -1; }
+	/** 分组内实例索引（顺序不固定），分组不存在时为空 */
+	TConstArrayView<int32> GetGroupMembers(int32 GroupId) const;
+
+	/**
+	 * 实例的标签位（64 位，含义由游戏定义，如阵营、兵种）
+	 */
+	void SetInstanceTags(int32 InstanceIndex, uint64 Tags) { if (IsInstanceAlive(InstanceIndex)) { SOA.Tags[InstanceIndex] = Tags; } }
+	void AddInstanceTags(int32 InstanceIndex, uint64 Tags) { if (IsInstanceAlive(InstanceIndex)) { SOA.Tags[InstanceIndex] |= Tags; } }
+	void RemoveInstanceTags(int32 InstanceIndex, uint64 Tags) { if (IsInstanceAlive(InstanceIndex)) { SOA.Tags[InstanceIndex] &= ~Tags; } }
+	uint64 GetInstanceTags(int32 InstanceIndex) const { return IsInstanceAlive(InstanceIndex) ? SOA.Tags[InstanceIndex] : 0; }
+
+	bool DoesInstanceMatchFilter(int32 InstanceIndex, const FSkelotInstanceFilter& Filter) const
+	{
+		return IsInstanceAlive(InstanceIndex) && (Filter.GroupId == -1 || SOA.Groups[InstanceIndex].GroupId == Filter.GroupId) && Filter.MatchTags(SOA.Tags[InstanceIndex]);
+	}
+	/**
+	 * 对所有符合筛选条件的实例并行调用 Proc(InstanceIndex)
+	 * 指定分组时只遍历分组成员，否则按存活位遍历全部实例。Proc 只能写入当前实例的数据
+	 */
+	void ParallelForEachInstanceInFilter(const FSkelotInstanceFilter& Filter, TFunctionRef<void(int32 InstanceIndex)> Proc) const;
+	/** 收集符合筛选条件的实例索引（按索引升序），匹配在并行阶段完成 */
+	void GatherInstances(const FSkelotInstanceFilter& Filter, TArray<int32>& OutIndices) const;
+	void QueryInstancesByFilter(const FSkelotInstanceFilter& Filter, TArray<FSkelotInstanceHandle>& OutHandles) const;
+	int32 CountInstancesByFilter(const FSkelotInstanceFilter& Filter) const;
+
+	/** 批量设置速度/自定义数据，并行写入（稀疏自定义数据列需要分配页，退化为单线程） */
+	void SetVelocityByFilter(const FSkelotInstanceFilter& Filter, const FVector3f& Velocity);
+	void SetCustomDataFloatByFilter(const FSkelotInstanceFilter& Filter, const float* Floats, int32 Offset, int32 Count);
+	/** 批量播放动画/销毁，先并行筛选再在游戏线程逐个执行，返回匹配的实例数量 */
+	int32 PlayAnimationByFilter(const FSkelotInstanceFilter& Filter, const FSkelotAnimPlayParams& Params);
+	int32 DestroyInstancesByFilter(const FSkelotInstanceFilter& Filter);
+
 	//////////////////////////////////////////////////////////////////////////
 	// Obstacle API
 	// 障碍物系统 API - PBD 碰撞的静态障碍物管理
@@ -879,12 +1100,16 @@ public:
 	//
 	FTransform3f ConsumeRootMotion(int32 InstanceIdx)
 	{
-		FTransform3f R = SOA.RootMotions[InstanceIdx];
-		SOA.RootMotions[InstanceIdx] = FTransform3f::Identity;
+		FTransform3f R = SOA.RootMotions.Get(InstanceIdx);
+		SOA.RootMotions.ResetInstance(InstanceIdx);
 		return R;
 	}
 
 	void Tick(float DeltaSeconds) override;
+	//spatial grid, RVO and PBD. touches only data of this shard so the primary shard runs it for all shards in parallel
+	void TickSimulation(float DeltaSeconds);
+	//snapshots RegisteredObstacles into the PBD obstacle cache if dirty. reads obstacle actors so must run on game thread before TickSimulation
+	void UpdateObstacleDataCache();
 	void BeginDestroy() override;
 	void BeginPlay() override;
 	void EndPlay(EEndPlayReason::Type Reason) override;
@@ -13,6 +13,7 @@
 #include "AlphaBlend.h"
 #include "AssetRegistry/AssetData.h"
 #include "UObject/PerPlatformProperties.h"
+#include "Async/ParallelFor.h"
 
 #include "SkelotWorldBase.generated.h"
 
@@ -88,7 +89,13 @@ struct FSkelotInstanceHandle
 	UPROPERTY()
 	uint32 Version = 0;
 
+	//top bits of Version encode the shard (ASkelotWorld::ShardIndex) the instance belongs to
+	static constexpr uint32 ShardShift = 28;
+	static constexpr uint32 MaxShards = 1 << (32 - ShardShift);
+	static constexpr uint32 SerialMask = (1u << ShardShift) - 1;
+
 	bool IsValid() const { return Version != 0; }
+	uint32 GetShardIndex() const { return Version >> ShardShift; }
 
 	bool operator == (const FSkelotInstanceHandle Other) const { return InstanceIndex == Other.InstanceIndex && Version == Other.Version; }
 
@@ -139,6 +146,21 @@ struct FSkelotAnimNotifyEvent
 	FName NotifyName;
 };
 
+// Skelot动画事件批次：同一帧内同一动画序列、同一通知名的所有实例
+USTRUCT(BlueprintType)
+struct FSkelotAnimEventBatch
+{
+	GENERATED_USTRUCT_BODY()
+
+	//None for finish events
+	UPROPERTY(BlueprintReadOnly, Category = "Skelot", meta = (DisplayName = "通知名称"))
+	FName NotifyName;
+	UPROPERTY(BlueprintReadOnly, Category = "Skelot", meta = (DisplayName = "动画序列"))
+	UAnimSequenceBase* AnimSequence = nullptr;
+	UPROPERTY(BlueprintReadOnly, Category = "Skelot", meta = (DisplayName = "实例句柄"))
+	TArray<FSkelotInstanceHandle> Handles;
+};
+
 struct FSkelotAnimNotifyObjectEvent
 {
 	FSkelotInstanceHandle Handle;
@@ -174,6 +196,25 @@ struct SKELOT_API FSkelotAnimPlayParams
 	bool bUnique = false;
 };
 
+// Skelot实例筛选条件，按分组和标签位选择实例进行批量操作
+USTRUCT(BlueprintType)
+struct SKELOT_API FSkelotInstanceFilter
+{
+	GENERATED_USTRUCT_BODY()
+
+	//only instances of this group, -1 for any group. see ASkelotWorld::SetInstanceGroup
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Skelot", meta = (DisplayName = "分组"))
+	int32 GroupId = -1;
+	//instance must have all of these tag bits
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Skelot", meta = (DisplayName = "必须包含标签"))
+	int64 RequiredTags = 0;
+	//instance must have none of these tag bits
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Skelot", meta = (DisplayName = "排除标签"))
+	int64 ExcludedTags = 0;
+
+	bool MatchTags(uint64 Tags) const { return (Tags & uint64(RequiredTags)) == uint64(RequiredTags) && (Tags & uint64(ExcludedTags)) == 0; }
+};
+
 
 
 DECLARE_DYNAMIC_DELEGATE_ThreeParams(FSkelotGeneralDynamicDelegate, FSkelotInstanceHandle, Handle, FName, PayloadTag, UObject*, PayloadObject);
@@ -206,6 +247,160 @@ struct FSkelotFrag_DynPoseTie
 };
 
 
+/*
+per instance column stored either densely (indexed by instance) or sparsely as pages of 64 instances allocated on first write.
+sparse storage is for data that only few instances use, reading an instance whose page isn't allocated returns the default value.
+Stride is the number of elements per instance. see USkelotDeveloperSettings for which columns are sparse.
+*/
+template<typename T> struct TSkelotInstanceColumn
+{
+	static constexpr int32 PageShift = 6;
+	static constexpr int32 PageSize = 1 << PageShift;
+
+	void Init(bool bInSparse, const T& InDefaultValue, int32 InStride = 1)
+	{
+		check(NumInstance == 0);
+		bSparse = bInSparse;
+		DefaultValue = InDefaultValue;
+		Stride = InStride;
+	}
+
+	bool IsSparse() const { return bSparse; }
+	int32 GetStride() const { return Stride; }
+	const T& GetDefaultValue() const { return DefaultValue; }
+
+	void AddInstances(int32 Count)
+	{
+		NumInstance += Count;
+		if (bSparse)
+			Pages.SetNum(FMath::DivideAndRoundUp(NumInstance, PageSize));
+		else
+		{
+			const int32 BaseIndex = Dense.AddUninitialized(Count * Stride);
+			for (int32 Index = BaseIndex; Index < Dense.Num(); Index++)
+				new (&Dense[Index]) T(DefaultValue);
+		}
+	}
+	//returns null if column is sparse and page of the instance isn't allocated
+	const T* Find(int32 InstanceIndex) const
+	{
+		if (!bSparse)
+			return Dense.GetData() + InstanceIndex * Stride;
+
+		const TArray<T>& Page = Pages[InstanceIndex >> PageShift];
+		return Page.Num() ? Page.GetData() + (InstanceIndex & (PageSize - 1)) * Stride : nullptr;
+	}
+	T* Find(int32 InstanceIndex) { return const_cast<T*>(static_cast<const TSkelotInstanceColumn*>(this)->Find(InstanceIndex)); }
+	//
+	const T& Get(int32 InstanceIndex) const
+	{
+		const T* Value = Find(InstanceIndex);
+		return Value ? *Value : DefaultValue;
+	}
+	//allocates the page if required, not thread safe in sparse mode
+	T* GetMutable(int32 InstanceIndex)
+	{
+		if (bSparse)
+		{
+			TArray<T>& Page = Pages[InstanceIndex >> PageShift];
+			if (Page.Num() == 0)
+				Page.Init(DefaultValue, PageSize * Stride);
+		}
+		return Find(InstanceIndex);
+	}
+	T& operator[](int32 InstanceIndex) { return *GetMutable(InstanceIndex); }
+	//sets the values of the instance back to default, never allocates so its safe to be called in parallel for different instances
+	void ResetInstance(int32 InstanceIndex)
+	{
+		if (T* Values = Find(InstanceIndex))
+		{
+			for (int32 i = 0; i < Stride; i++)
+				Values[i] = DefaultValue;
+		}
+	}
+	//change number of elements per instance, existing values are kept
+	void SetStride(int32 NewStride)
+	{
+		check(NewStride > Stride);
+		auto Relayout = [&](TArray<T>& Array, int32 Num) {
+			TArray<T> OldData = MoveTemp(Array);
+			Array.Init(DefaultValue, Num * NewStride);
+			for (int32 Index = 0; Index < Num && OldData.Num(); Index++)
+				for (int32 DataIndex = 0; DataIndex < Stride; DataIndex++)
+					Array[Index * NewStride + DataIndex] = MoveTemp(OldData[Index * Stride + DataIndex]);
+		};
+
+		//dense array is empty while Stride is 0 but must always cover every instance
+		if (!bSparse)
+			Relayout(Dense, NumInstance);
+
+		for (TArray<T>& Page : Pages)
+		{
+			if (Page.Num()) //unallocated pages stay unallocated
+				Relayout(Page, PageSize);
+		}
+
+		Stride = NewStride;
+	}
+
+	SIZE_T GetAllocatedSize() const
+	{
+		SIZE_T Size = Dense.GetAllocatedSize() + Pages.GetAllocatedSize();
+		for (const TArray<T>& Page : Pages)
+			Size += Page.GetAllocatedSize();
+
+		return Size;
+	}
+
+private:
+	TArray<T> Dense;
+	TArray<TArray<T>> Pages;
+	T DefaultValue = T();
+	int32 NumInstance = 0;
+	int32 Stride = 1;
+	bool bSparse = false;
+};
+
+
+//bit mask of the sub meshes attached to an instance, bit index is index for FSkelotInstanceRenderDesc.Meshes[]
+struct FSkelotSubmeshMask
+{
+	static constexpr uint32 MaxSubmesh = 128;
+
+	uint64 Words[2] = {};
+
+	bool IsSet(uint32 SubMeshIdx) const { check(SubMeshIdx < MaxSubmesh); return (Words[SubMeshIdx >> 6] >> (SubMeshIdx & 63)) & 1; }
+	void Set(uint32 SubMeshIdx) { check(SubMeshIdx < MaxSubmesh); Words[SubMeshIdx >> 6] |= uint64(1) << (SubMeshIdx & 63); }
+	void Clear(uint32 SubMeshIdx) { check(SubMeshIdx < MaxSubmesh); Words[SubMeshIdx >> 6] &= ~(uint64(1) << (SubMeshIdx & 63)); }
+	void Reset() { Words[0] = Words[1] = 0; }
+
+	bool IsEmpty() const { return (Words[0] | Words[1]) == 0; }
+	uint32 Num() const { return static_cast<uint32>(FMath::CountBits(Words[0]) + FMath::CountBits(Words[1])); }
+
+	FSkelotSubmeshMask operator & (const FSkelotSubmeshMask& Other) const { return FSkelotSubmeshMask{ { Words[0] & Other.Words[0], Words[1] & Other.Words[1] } }; }
+	FSkelotSubmeshMask operator | (const FSkelotSubmeshMask& Other) const { return FSkelotSubmeshMask{ { Words[0] | Other.Words[0], Words[1] | Other.Words[1] } }; }
+	FSkelotSubmeshMask operator ~ () const { return FSkelotSubmeshMask{ { ~Words[0], ~Words[1] } }; }
+	bool operator == (const FSkelotSubmeshMask& Other) const { return Words[0] == Other.Words[0] && Words[1] == Other.Words[1]; }
+	bool operator != (const FSkelotSubmeshMask& Other) const { return !(*this == Other); }
+
+	//calls Proc(uint8 SubMeshIdx) for every set bit in ascending order
+	template<typename TLambda> void ForEach(TLambda Proc) const
+	{
+		for (uint32 WordIndex = 0; WordIndex < UE_ARRAY_COUNT(Words); WordIndex++)
+			for (uint64 Word = Words[WordIndex]; Word; Word &= Word - 1)
+				Proc(static_cast<uint8>(WordIndex * 64 + FMath::CountTrailingZeros64(Word)));
+	}
+};
+
+
+//systems whose update rate is driven by significance tiers
+enum class ESkelotSignificanceUser : uint8
+{
+	Animation,
+	RVO,
+	PBD,
+	Num
+};
 
 /*
 instance data as struct of arrays
@@ -232,14 +427,23 @@ struct SKELOT_API FSkelotInstancesSOA
 		uint32 bApplyRootMotion : 1 = false;
 
 		uint32 bCreatedThisFrame : 1 = false;
+		//set by play and on composite segment switch, next animation update includes the frame it starts at in notify evaluation
+		uint32 bNotifyFromRangeStart : 1 = false;
+
+		//movement flags, see ASkelotWorld::SetInstanceVelocityIntegration
+		uint32 bIntegrateVelocity : 1 = false;
+		//instance has an entry in ASkelotWorld::PendingVelocityAdvances, cleared after the pass
+		uint32 bIntegrateVelocityOnce : 1 = false;
+		uint32 bFaceVelocity : 1 = false;
+		uint32 bSnapToGround : 1 = false;
 
 		uint8 UserFlags = 0;
 
 		void IncVersion()
 		{
-			Version++;
-			if(Version == 0)
-				Version = 1;
+			//shard bits are kept, the serial part wraps skipping zero
+			const uint32 Serial = (Version + 1) & FSkelotInstanceHandle::SerialMask;
+			Version = (Version & ~FSkelotInstanceHandle::SerialMask) | (Serial ? Serial : 1);
 		}
 	};
 
@@ -255,6 +459,10 @@ struct SKELOT_API FSkelotInstancesSOA
 		uint16 AnimationCurrentSequence = 0xFFff;
 		//index for AnimCollection->Transitions[] if any
 		uint16 AnimationTransitionIndex = 0xFFff;
+		//index for AnimCollection->CompositeDefs[] if playing an UAnimComposite
+		uint16 AnimationCompositeIndex = 0xFFff;
+		//index of the segment being played if playing an UAnimComposite, only advances forward unless the track wraps
+		uint16 AnimationCurrentSegment = 0;
 		//time since start of play
 		float AnimationTime = 0;
 		//#Note negative not supported
@@ -265,6 +473,7 @@ struct SKELOT_API FSkelotInstancesSOA
 
 		bool IsSequenceValid() const { return AnimationCurrentSequence != 0xFFff; }
 		bool IsTransitionValid() const { return AnimationTransitionIndex != 0xFFff; }
+		bool IsCompositeValid() const { return AnimationCompositeIndex != 0xFFff; }
 	};
 
 
@@ -319,11 +528,12 @@ struct SKELOT_API FSkelotInstancesSOA
 	//
 	TArray<FClusterData>	ClusterData;
 	//
-	TArray<uint8>			SubmeshIndices;
+	//attached sub meshes, see ASkelotWorld::GetInstanceSubmeshMask
+	TArray<FSkelotSubmeshMask>	SubmeshMasks;
 	//
 	TArray<FUserData>		UserData;
-	//holds per instance custom data float, see GetInstanceCustomDataFloats()
-	TArray<float>			PerInstanceCustomData;
+	//holds per instance custom data float, see GetInstanceCustomDataFloats(). stride is MaxNumCustomDataFloat
+	TSkelotInstanceColumn<float>	PerInstanceCustomData;
 	//
 	int32 MaxNumCustomDataFloat = 0;
 	
@@ -331,13 +541,136 @@ struct SKELOT_API FSkelotInstancesSOA
 	//just like UserData but used by blueprint, array might be empty, resized on demand,see SetInstanceUserObject
 	UPROPERTY()
 	TArray<TObjectPtr<UObject>> UserObjects;
+	//used instead of UserObjects if bSparseUserObjects is true
+	UPROPERTY()
+	TMap<int32, TObjectPtr<UObject>> SparseUserObjects;
+	bool bSparseUserObjects = false;
+
+	TSkelotInstanceColumn<FMiscData>	MiscData;
+
+	//one bit per instance, set while the instance is alive. mirrors FSlotData::bDestroyed so loops can skip 64 dead slots at once
+	TArray<uint64>			AliveMask;
+
+	//thread safe, may be called from parallel creation
+	void SetAliveBit(int32 InstanceIndex, bool bAlive)
+	{
+		volatile int64* Word = reinterpret_cast<volatile int64*>(&AliveMask[InstanceIndex >> 6]);
+		const int64 Bit = static_cast<int64>(uint64(1) << (InstanceIndex & 63));
+		if (bAlive)
+			FPlatformAtomics::InterlockedOr(Word, Bit);
+		else
+			FPlatformAtomics::InterlockedAnd(Word, ~Bit);
+	}
+	/*
+	splits the alive mask of [0, NumInstance) in word aligned ranges and runs Proc(FirstWord, EndWord) on them in parallel.
+	range count is derived from the worker count, small worlds run single threaded (see skelot.MinParallelBatchSize).
+	Proc must not write sparse TSkelotInstanceColumn, GetMutable allocates pages and isn't thread safe.
+	*/
+	void ParallelForAliveWords(int32 NumInstance, EParallelForFlags Flags, TFunctionRef<void(int32 FirstWord, int32 EndWord)> Proc) const;
+	/*
+	calls Functor(InstanceIndex, Columns[InstanceIndex]...) for every alive instance in parallel. columns are any SOA arrays indexed by instance, e.g :
+	SOA.ParallelForEachAlive(Num, EParallelForFlags::None, [](int32 Index, FVector3d& Location, const FVector3f& Velocity) { ... }, SOA.Locations, SOA.Velocities);
+	functor must only write data of the instance it is called for. sparse columns are rejected since accessing them may allocate.
+	*/
+	template<typename T, typename TAllocator> static bool IsParallelColumn(const TArray<T, TAllocator>& Column, int32 NumInstance) { return Column.Num() >= NumInstance; }
+	template<typename T> static bool IsParallelColumn(const TSkelotInstanceColumn<T>& Column, int32 NumInstance) { return !Column.IsSparse(); }
+
+	template<typename TFunctor, typename... TColumns> void ParallelForEachAlive(int32 NumInstance, EParallelForFlags Flags, TFunctor&& Functor, TColumns&... Columns) const
+	{
+		check((IsParallelColumn(Columns, NumInstance) && ...));
+		ParallelForAliveWords(NumInstance, Flags, [&](int32 FirstWord, int32 EndWord) {
+			for (int32 WordIndex = FirstWord; WordIndex < EndWord; WordIndex++)
+			{
+				for (uint64 Word = AliveMask[WordIndex]; Word; Word &= Word - 1)
+				{
+					const int32 InstanceIndex = WordIndex * 64 + static_cast<int32>(FMath::CountTrailingZeros64(Word));
+					if (InstanceIndex >= NumInstance)
+						break;
+
+					Functor(InstanceIndex, Columns[InstanceIndex]...);
+				}
+			}
+		});
+	}
 
-	TArray<FMiscData>			MiscData;
+	//one bit per instance, set when its transform is written during the frame. cleared at the end of ASkelotWorld::OnWorldPostActorTick
+	TArray<uint64>			TransformDirtyMask;
+
+	//thread safe, may be called from parallel loops
+	void MarkTransformDirty(int32 InstanceIndex)
+	{
+		uint64& Word = TransformDirtyMask[InstanceIndex >> 6];
+		const uint64 Bit = uint64(1) << (InstanceIndex & 63);
+		if (!(Word & Bit))
+			FPlatformAtomics::InterlockedOr(reinterpret_cast<volatile int64*>(&Word), static_cast<int64>(Bit));
+	}
+	//calls Proc(InstanceIndex) for every instance whose transform was written this frame, destroyed ones included
+	template<typename TLambda> void ForEachTransformDirty(int32 NumInstance, TLambda Proc) const
+	{
+		const int32 NumWord = FMath::DivideAndRoundUp(NumInstance, 64);
+		for (int32 WordIndex = 0; WordIndex < NumWord; WordIndex++)
+		{
+			for (uint64 Word = TransformDirtyMask[WordIndex]; Word; Word &= Word - 1)
+			{
+				Proc(WordIndex * 64 + static_cast<int32>(FMath::CountTrailingZeros64(Word)));
+			}
+		}
+	}
 	
 
+	//accumulated root motion of instances with bExtractRootMotion
+	TSkelotInstanceColumn<FTransform3f> RootMotions;
 
+	//per instance random state (xorshift32, never zero) used for notify trigger chance rolls
+	TArray<uint32>			RandomStates;
 
-	TArray<FTransform3f> RootMotions;
+	//thread safe for different instances
+	uint32 NextInstanceRandom(int32 InstanceIndex)
+	{
+		uint32& State = RandomStates[InstanceIndex];
+		State ^= State << 13;
+		State ^= State >> 17;
+		State ^= State << 5;
+		return State;
+	}
+
+	struct FGroupData
+	{
+		//-1 if instance isn't in any group
+		int32 GroupId = -1;
+		//index for ASkelotWorld.GroupMembers[GroupId]
+		int32 MemberIndex = -1;
+	};
+	//gameplay tag bits of instances, see ASkelotWorld::SetInstanceTags
+	TArray<uint64>			Tags;
+	//group membership of instances, see ASkelotWorld::SetInstanceGroup
+	TArray<FGroupData>		Groups;
+
+	//distance LOD level of instances (0 near, 1 medium, 2 far) by nearest viewer, see ASkelotWorld::GetInstanceLODLevel
+	TArray<uint8>			LODLevels;
+
+	//significance score of instances (0-1), computed every frame if significance is enabled, see FSkelotSignificanceConfig
+	TArray<float>			Significances;
+	//gameplay set priority (0-255), one of the inputs of significance
+	TArray<uint8>			SignificancePriorities;
+	//update tier assigned under the budget, instance is updated every 1 << Tier frames
+	TArray<uint8>			SignificanceTiers;
+	//animation time elapsed since the instance was last updated by significance, applied at its next update
+	TArray<float>			SignificanceAnimDeltas;
+	//per user update bits of the current frame, empty if significance is disabled (everything updates)
+	TArray<uint64>			SignificanceUpdateMasks[(int32)ESkelotSignificanceUser::Num];
+
+	//thread safe, may be called from parallel loops of the user
+	bool ShouldUpdateBySignificance(ESkelotSignificanceUser User, int32 InstanceIndex) const
+	{
+		const TArray<uint64>& Mask = SignificanceUpdateMasks[(int32)User];
+		return Mask.Num() == 0 || ((Mask[InstanceIndex >> 6] >> (InstanceIndex & 63)) & 1);
+	}
+	//staggered by instance index so instances of the same tier are spread over frames
+	static bool IsTierUpdateFrame(uint32 Tier, int32 InstanceIndex, uint64 FrameNumber)
+	{
+		return ((FrameNumber + InstanceIndex) & ((uint64(1) << Tier) - 1)) == 0;
+	}
 };
 
 
@@ -420,6 +753,10 @@ struct FSkelotCluster
 	uint32 KillCounter = 0;
 	//true if any instances was add/removed to this cluster this frame
 	uint32 bAnyAddRemove : 1 = true;
+	//true if Bounds may be larger than needed because an instance left or moved, rebuilt lazily. see skelot.ClusterBoundsShrinkInterval
+	uint32 bBoundsMayShrink : 1 = false;
+	//approximate world space bound of the instances, grown incrementally by moved instances. see ASkelotWorld_Impl::CalculateBounds
+	FBox Bounds = FBox(ForceInit);
 	//true if this cluster is way far from main camera 
 	//uint32 bLowQuality : 1 = false;
 	//
@@ -559,6 +896,8 @@ struct SKELOT_API FSkelotInstanceRenderDescFinal : public FSkelotInstanceRenderD
 	TSet<FSkelotCluster> Clusters;
 	//
 	uint32 KillCounter = 0;
+	//radius of a sphere around the origin containing the max bound of all meshes, used for fast instance bounds
+	float BoundRadius = 0;
 	
 	FSkelotInstanceRenderDescFinal(){}
 	FSkelotInstanceRenderDescFinal(const FSkelotInstanceRenderDesc& Copy) 
@@ -591,6 +930,15 @@ struct FSkelotLifeSpan
 	double DeathTime;
 };
 
+//element of the min heaps used for lifespans and timers, ordered by expiry time
+struct FSkelotExpiryHeapEntry
+{
+	double Time;
+	FSkelotInstanceHandle Handle;
+
+	bool operator < (const FSkelotExpiryHeapEntry& Other) const { return Time < Other.Time; }
+};
+
 
 
 //keeps a delegate and its values